@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+#include "vec.hpp"
+
+// A bump allocator for heap blocks which all die together (e.g. everything
+// built while handling one request). Allocating is a pointer bump, freeing a
+// single block does nothing, and release() gives all of it back at once.
+// Not thread safe, so use one arena per thread / request.
+class MonotonicArena {
+private:
+  // Each chunk we get from operator new starts with one of these, so we can
+  // walk back through them in release()
+  struct Chunk {
+    Chunk *prev;
+    size_t size;
+  };
+
+  Chunk *head_ = nullptr;
+  std::byte *cur_ = nullptr;
+  std::byte *end_ = nullptr;
+  size_t next_chunk_size_;
+
+  // Gets a new chunk big enough for `bytes` aligned to `alignment`. Chunks
+  // double in size so big arenas don't need many of them, until doubling
+  // again would overflow
+  void add_chunk(size_t bytes, size_t alignment) {
+    if (bytes > SIZE_MAX - sizeof(Chunk) - alignment)
+      throw std::bad_alloc();
+    const size_t needed = sizeof(Chunk) + bytes + alignment;
+    size_t size = next_chunk_size_;
+    while (size < needed) {
+      if (size > SIZE_MAX / 2) {
+        size = needed;
+        break;
+      }
+      size *= 2;
+    }
+    auto *chunk = static_cast<Chunk *>(::operator new(size));
+    chunk->prev = head_;
+    chunk->size = size;
+    head_ = chunk;
+    cur_ = reinterpret_cast<std::byte *>(chunk + 1);
+    end_ = reinterpret_cast<std::byte *>(chunk) + size;
+    next_chunk_size_ = size > SIZE_MAX / 2 ? size : size * 2;
+  }
+
+public:
+  explicit MonotonicArena(size_t initial_chunk_size = 4096)
+      : next_chunk_size_(std::max(initial_chunk_size, sizeof(Chunk))) {}
+
+  MonotonicArena(const MonotonicArena &) = delete;
+  MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+  ~MonotonicArena() { release(); }
+
+  // Returns `bytes` of memory aligned to `alignment` (a power of two), which
+  // lives until release() is called
+  void *allocate(size_t bytes, size_t alignment) {
+    void *ptr = cur_;
+    size_t space = static_cast<size_t>(end_ - cur_);
+    if (head_ == nullptr || !std::align(alignment, bytes, ptr, space)) {
+      add_chunk(bytes, alignment);
+      ptr = cur_;
+      space = static_cast<size_t>(end_ - cur_);
+      std::align(alignment, bytes, ptr, space);
+    }
+    cur_ = static_cast<std::byte *>(ptr) + bytes;
+    return ptr;
+  }
+
+  // Frees every chunk, invalidating everything allocated from the arena
+  void release() noexcept {
+    while (head_ != nullptr) {
+      Chunk *prev = head_->prev;
+      ::operator delete(head_);
+      head_ = prev;
+    }
+    cur_ = end_ = nullptr;
+  }
+};
+
+// A std::allocator compatible handle to a MonotonicArena. deallocate() is a
+// no-op, the memory is only given back when the arena is released
+template <typename T> class ArenaAllocator {
+private:
+  template <typename U> friend class ArenaAllocator;
+
+  MonotonicArena *arena_;
+
+public:
+  using value_type = T;
+
+  ArenaAllocator(MonotonicArena &arena) noexcept : arena_(&arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+      : arena_(other.arena_) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *, size_t) noexcept {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &other) const noexcept {
+    return arena_ == other.arena_;
+  }
+};
+
+// A SmallVector whose heap block (if it ever spills over) comes from a
+// MonotonicArena
+template <typename T,
+          size_t STATIC_AMOUNT = calculate_static_size(
+              sizeof(T), header_size_bytes() + sizeof(ArenaAllocator<T>))>
+using ArenaSmallVector =
+    SmallVector<T, STATIC_AMOUNT, size_t, ArenaAllocator<T>>;
@@ -0,0 +1,287 @@
+// Benchmarks SmallVector against std::vector, and optionally LLVM's
+// SmallVector, boost::container::small_vector and absl::InlinedVector.
+// Uses Google Benchmark, build from the repo root with something like:
+//
+//   g++ -std=c++20 -O2 -DNDEBUG -I. bench/bench.cpp -o bench_suite
+//       -lbenchmark -lpthread
+//
+// and add any of these to also compare against the other implementations:
+//
+//   -DBENCH_BOOST
+//   -DBENCH_ABSL -labsl_throw_delegate -labsl_raw_logging_internal
+//   -DBENCH_LLVM -I/usr/include/llvm-14 -L/usr/lib/llvm-14/lib -lLLVM
+//       -Wl,-rpath,/usr/lib/llvm-14/lib
+//
+// Every case is run for each element type (int, a 24 byte POD, std::string
+// and a 200 byte struct) and each STATIC_AMOUNT, with sizes on both sides of
+// the spillover. Use --benchmark_filter to pick a subset, e.g.
+// --benchmark_filter='push_back<SmallVector,int'
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vec.hpp"
+
+#ifdef BENCH_BOOST
+#include <boost/container/small_vector.hpp>
+#endif
+#ifdef BENCH_ABSL
+#include <absl/container/inlined_vector.h>
+#endif
+#ifdef BENCH_LLVM
+#include <llvm/ADT/SmallVector.h>
+#endif
+
+// ----- ELEMENT TYPES -----
+
+struct Pod24 {
+  int64_t a;
+  int64_t b;
+  int64_t c;
+};
+
+struct Big200 {
+  int64_t key;
+  char payload[192];
+};
+
+template <typename T> T make_value(size_t i);
+template <> int make_value<int>(size_t i) { return static_cast<int>(i); }
+template <> Pod24 make_value<Pod24>(size_t i) {
+  const auto v = static_cast<int64_t>(i);
+  return {v, v, v};
+}
+template <> std::string make_value<std::string>(size_t i) {
+  return "value_" + std::to_string(i);
+}
+template <> Big200 make_value<Big200>(size_t i) {
+  Big200 big{};
+  big.key = static_cast<int64_t>(i);
+  return big;
+}
+
+// Something cheap to read out of each value, so the loops can't be thrown away
+inline int64_t key_of(int v) { return v; }
+inline int64_t key_of(const Pod24 &v) { return v.a; }
+inline int64_t key_of(const std::string &v) {
+  return static_cast<int64_t>(v.size());
+}
+inline int64_t key_of(const Big200 &v) { return v.key; }
+
+// ----- CONTAINERS -----
+// All take <T, N> so they can be registered the same way
+
+template <typename T, size_t N> using ThisSmallVector = SmallVector<T, N>;
+template <typename T, size_t> using StdVector = std::vector<T>;
+#ifdef BENCH_BOOST
+template <typename T, size_t N>
+using BoostSmallVector = boost::container::small_vector<T, N>;
+#endif
+#ifdef BENCH_ABSL
+template <typename T, size_t N>
+using AbslInlinedVector = absl::InlinedVector<T, N>;
+#endif
+#ifdef BENCH_LLVM
+template <typename T, size_t N> using LlvmSmallVector = llvm::SmallVector<T, N>;
+#endif
+
+template <typename Vec> Vec make_filled(size_t count) {
+  Vec v;
+  for (size_t i = 0; i < count; ++i) {
+    v.push_back(make_value<typename Vec::value_type>(i));
+  }
+  return v;
+}
+
+// ----- CASES -----
+
+// Builds a container of state.range(0) values one push_back at a time
+template <typename Vec> void bm_push_back(benchmark::State &state) {
+  using T = typename Vec::value_type;
+  const auto count = static_cast<size_t>(state.range(0));
+  const std::vector<T> values = make_filled<std::vector<T>>(count);
+  for (auto _ : state) {
+    Vec v;
+    for (const T &value : values) {
+      v.push_back(value);
+    }
+    benchmark::DoNotOptimize(v.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Reads values at random indices
+template <typename Vec> void bm_random_access(benchmark::State &state) {
+  const auto count = static_cast<size_t>(state.range(0));
+  const Vec v = make_filled<Vec>(count);
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> dist(0, count - 1);
+  std::vector<size_t> indices(1024);
+  for (size_t &idx : indices) {
+    idx = dist(rng);
+  }
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (size_t idx : indices) {
+      sum += key_of(v[idx]);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(indices.size()));
+}
+
+enum class Where { Front, Middle, Back };
+
+template <typename Vec> size_t position(const Vec &v, Where where) {
+  switch (where) {
+  case Where::Front:
+    return 0;
+  case Where::Middle:
+    return v.size() / 2;
+  case Where::Back:
+  default:
+    return v.size();
+  }
+}
+
+// Builds a container of state.range(0) values by inserting at `WHERE`
+template <typename Vec, Where WHERE> void bm_insert(benchmark::State &state) {
+  using T = typename Vec::value_type;
+  const auto count = static_cast<size_t>(state.range(0));
+  const T value = make_value<T>(7);
+  for (auto _ : state) {
+    Vec v;
+    for (size_t i = 0; i < count; ++i) {
+      v.insert(v.begin() + static_cast<ptrdiff_t>(position(v, WHERE)), value);
+    }
+    benchmark::DoNotOptimize(v.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Empties a container of state.range(0) values by erasing at `WHERE`. Pausing
+// the timer costs a few hundred ns, which would swamp emptying a small
+// container, so the filled copies are made ERASE_BATCH at a time with the
+// timer paused just once for all of them
+constexpr int64_t ERASE_BATCH = 64;
+
+template <typename Vec, Where WHERE> void bm_erase(benchmark::State &state) {
+  const auto count = static_cast<size_t>(state.range(0));
+  const Vec filled = make_filled<Vec>(count);
+  std::vector<Vec> batch;
+  batch.reserve(ERASE_BATCH);
+  while (state.KeepRunningBatch(ERASE_BATCH)) {
+    state.PauseTiming();
+    batch.assign(ERASE_BATCH, filled);
+    state.ResumeTiming();
+    for (Vec &v : batch) {
+      while (!v.empty()) {
+        const size_t idx = std::min(position(v, WHERE), v.size() - 1);
+        v.erase(v.begin() + static_cast<ptrdiff_t>(idx));
+      }
+      benchmark::DoNotOptimize(v.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Vec> void bm_copy(benchmark::State &state) {
+  const Vec v = make_filled<Vec>(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    Vec copy(v);
+    benchmark::DoNotOptimize(copy.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Vec> void bm_move(benchmark::State &state) {
+  Vec a = make_filled<Vec>(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    // Bounce back and forth so there is always something to move
+    Vec b(std::move(a));
+    benchmark::DoNotOptimize(b.data());
+    a = std::move(b);
+    benchmark::DoNotOptimize(a.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Vec> void bm_iterate(benchmark::State &state) {
+  const Vec v = make_filled<Vec>(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (const auto &value : v) {
+      sum += key_of(value);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// ----- REGISTRATION -----
+
+template <template <typename, size_t> typename Vec, typename T, size_t N>
+void register_cases(const std::string &vec_name, const std::string &t_name) {
+  using V = Vec<T, N>;
+  const std::string suffix =
+      "<" + vec_name + "," + t_name + "," + std::to_string(N) + ">";
+  const std::pair<const char *, void (*)(benchmark::State &)> cases[] = {
+      {"push_back", bm_push_back<V>},
+      {"random_access", bm_random_access<V>},
+      {"insert_front", bm_insert<V, Where::Front>},
+      {"insert_middle", bm_insert<V, Where::Middle>},
+      {"insert_back", bm_insert<V, Where::Back>},
+      {"erase_front", bm_erase<V, Where::Front>},
+      {"erase_middle", bm_erase<V, Where::Middle>},
+      {"erase_back", bm_erase<V, Where::Back>},
+      {"copy", bm_copy<V>},
+      {"move", bm_move<V>},
+      {"iterate", bm_iterate<V>},
+  };
+  for (const auto &[name, fn] : cases) {
+    // Half full inline, only just spilt over, and well past the spillover
+    benchmark::RegisterBenchmark((name + suffix).c_str(), fn)
+        ->Arg(std::max<int64_t>(1, N / 2))
+        ->Arg(N + 1)
+        ->Arg(N * 64);
+  }
+}
+
+template <template <typename, size_t> typename Vec>
+void register_container(const std::string &vec_name) {
+  register_cases<Vec, int, 4>(vec_name, "int");
+  register_cases<Vec, int, 16>(vec_name, "int");
+  register_cases<Vec, Pod24, 4>(vec_name, "Pod24");
+  register_cases<Vec, Pod24, 16>(vec_name, "Pod24");
+  register_cases<Vec, std::string, 4>(vec_name, "string");
+  register_cases<Vec, std::string, 16>(vec_name, "string");
+  register_cases<Vec, Big200, 4>(vec_name, "Big200");
+  register_cases<Vec, Big200, 16>(vec_name, "Big200");
+}
+
+int main(int argc, char **argv) {
+  register_container<ThisSmallVector>("SmallVector");
+  register_container<StdVector>("std::vector");
+#ifdef BENCH_BOOST
+  register_container<BoostSmallVector>("boost::small_vector");
+#endif
+#ifdef BENCH_ABSL
+  register_container<AbslInlinedVector>("absl::InlinedVector");
+#endif
+#ifdef BENCH_LLVM
+  register_container<LlvmSmallVector>("llvm::SmallVector");
+#endif
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
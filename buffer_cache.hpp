@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "vec.hpp"
+
+// A per-thread cache of recently freed heap blocks, for SmallVectors which
+// keep spilling over, being destroyed, and spilling over again. Freed blocks
+// go onto a free list for their power of two size class instead of back to
+// operator delete, and the next spill of that size pops one off without
+// calling the allocator at all. Use it through ThreadCachedAllocator or
+// CachedSmallVector below
+class ThreadBufferCache {
+public:
+  // Blocks are rounded up to a power of two between these sizes. Anything
+  // bigger goes straight to operator new / delete
+  static constexpr size_t MIN_BLOCK_BYTES = 16;
+  static constexpr size_t MAX_BLOCK_BYTES = 64 * 1024;
+  // How many free blocks each size class keeps at most, so a burst of frees
+  // can't pin down lots of memory
+  static constexpr size_t BLOCKS_PER_BUCKET = 8;
+  static constexpr size_t BUCKETS = std::bit_width(MAX_BLOCK_BYTES) -
+                                    std::bit_width(MIN_BLOCK_BYTES) + 1;
+
+  // Counts for the calling thread's cache
+  struct Stats {
+    uint64_t hits = 0;   // Allocations served from a free list
+    uint64_t misses = 0; // Cacheable allocations which went to operator new
+  };
+
+  static constexpr bool is_cacheable(size_t bytes) noexcept {
+    return bytes <= MAX_BLOCK_BYTES;
+  }
+
+  // The size of the block actually handed out for `bytes`
+  static constexpr size_t block_bytes(size_t bytes) noexcept {
+    return std::bit_ceil(std::max(bytes, MIN_BLOCK_BYTES));
+  }
+
+  static void *allocate(size_t bytes) {
+    if (!is_cacheable(bytes))
+      return ::operator new(bytes);
+    State &state = local();
+    Bucket &bucket = state.buckets[bucket_of(bytes)];
+    if (bucket.head != nullptr) {
+      FreeBlock *block = bucket.head;
+      bucket.head = block->next;
+      --bucket.count;
+      ++state.stats.hits;
+      return block;
+    }
+    ++state.stats.misses;
+    return ::operator new(block_bytes(bytes));
+  }
+
+  static void deallocate(void *ptr, size_t bytes) noexcept {
+    if (!is_cacheable(bytes)) {
+      ::operator delete(ptr, bytes);
+      return;
+    }
+    State &state = local();
+    Bucket &bucket = state.buckets[bucket_of(bytes)];
+    if (state.dead || bucket.count == BLOCKS_PER_BUCKET) {
+      ::operator delete(ptr, block_bytes(bytes));
+      return;
+    }
+    if (!state.reaper_registered)
+      register_reaper(state);
+    bucket.head = new (ptr) FreeBlock{bucket.head};
+    ++bucket.count;
+  }
+
+  // Gives every cached block on this thread back to operator delete
+  static void trim() noexcept { trim(local()); }
+
+  static Stats stats() noexcept { return local().stats; }
+  static void reset_stats() noexcept { local().stats = {}; }
+
+private:
+  // A free block holds the link to the next one
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct Bucket {
+    FreeBlock *head = nullptr;
+    size_t count = 0;
+  };
+
+  // Trivially destructible, so it's still there to be used by SmallVectors
+  // which are destroyed during thread exit after the Reaper has run
+  struct State {
+    Bucket buckets[BUCKETS] = {};
+    Stats stats = {};
+    bool reaper_registered = false;
+    bool dead = false; // Thread is exiting, so stop caching
+  };
+
+  // Frees the cached blocks when the thread exits
+  struct Reaper {
+    ~Reaper() {
+      State &state = local();
+      state.dead = true;
+      trim(state);
+    }
+  };
+
+  static State &local() noexcept {
+    thread_local constinit State state;
+    return state;
+  }
+
+  static void register_reaper(State &state) noexcept {
+    state.reaper_registered = true;
+    thread_local Reaper reaper;
+    (void)reaper;
+  }
+
+  static constexpr size_t bucket_of(size_t bytes) noexcept {
+    return static_cast<size_t>(std::bit_width(block_bytes(bytes) - 1)) -
+           (std::bit_width(MIN_BLOCK_BYTES) - 1);
+  }
+
+  static void trim(State &state) noexcept {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      Bucket &bucket = state.buckets[i];
+      while (bucket.head != nullptr) {
+        FreeBlock *next = bucket.head->next;
+        ::operator delete(static_cast<void *>(bucket.head),
+                          MIN_BLOCK_BYTES << i);
+        bucket.head = next;
+      }
+      bucket.count = 0;
+    }
+  }
+};
+
+// A stateless allocator which gets its blocks through the calling thread's
+// ThreadBufferCache. Over-aligned types skip the cache
+template <typename T> struct ThreadCachedAllocator {
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  ThreadCachedAllocator() noexcept = default;
+  template <typename U>
+  ThreadCachedAllocator(const ThreadCachedAllocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      return static_cast<T *>(
+          ::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    } else {
+      return static_cast<T *>(ThreadBufferCache::allocate(n * sizeof(T)));
+    }
+  }
+
+  void deallocate(T *ptr, size_t n) noexcept {
+    if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      ::operator delete(ptr, n * sizeof(T), std::align_val_t(alignof(T)));
+    } else {
+      ThreadBufferCache::deallocate(ptr, n * sizeof(T));
+    }
+  }
+
+  template <typename U>
+  bool operator==(const ThreadCachedAllocator<U> &) const noexcept {
+    return true;
+  }
+};
+
+// A SmallVector whose heap blocks come from the thread's ThreadBufferCache.
+// It grows to power of two sized blocks, so every capacity it picks uses all
+// of the cached block it gets
+template <typename T, size_t STATIC_AMOUNT = calculate_static_size(sizeof(T))>
+using CachedSmallVector =
+    SmallVector<T, STATIC_AMOUNT, size_t, ThreadCachedAllocator<T>,
+                GrowToPowerOfTwo>;
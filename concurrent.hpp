@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "vec.hpp"
+
+// A SmallVector which many threads can push_back() into at once, e.g. worker
+// threads appending results into one shared collector. A push_back() claims
+// its index with a single fetch_add, and there are no locks anywhere.
+//
+// The values live in segments which never move: the first STATIC_AMOUNT are
+// inline like a SmallVector's, and after that each heap segment is as big as
+// everything before it. So references stay valid while other threads append,
+// at the cost of the values not being contiguous. Once the appending is done,
+// freeze() moves them all into a plain SmallVector.
+//
+// Only push_back() / emplace_back() and reading values you have synchronised
+// with (e.g. your own, or everything after joining the writers) are thread
+// safe. Everything else must not race with an append
+template <typename T, size_t STATIC_AMOUNT = calculate_static_size(sizeof(T))>
+class ConcurrentSmallVector {
+private:
+  static_assert(STATIC_AMOUNT > 0, "STATIC_AMOUNT must be at least 1");
+
+  // Segment k (for k > 0) holds STATIC_AMOUNT << (k - 1) values, so this many
+  // is always enough to reach max_size()
+  static constexpr size_t MAX_SEGMENTS = std::numeric_limits<size_t>::digits;
+
+  using AllocTraits = std::allocator_traits<std::allocator<T>>;
+
+  // Keep the counter every push_back() hammers on off the values' cache lines
+  alignas(CACHE_LINE_SIZE_BYTES) std::atomic<size_t> size_{0};
+  // segments_[0] is always null, as the first segment is arr_
+  std::array<std::atomic<T *>, MAX_SEGMENTS> segments_{};
+
+  alignas(CACHE_LINE_SIZE_BYTES) alignas(T)
+      std::byte arr_[STATIC_AMOUNT * sizeof(T)];
+
+  static constexpr size_t segment_capacity(size_t segment) noexcept {
+    return segment == 0 ? STATIC_AMOUNT : STATIC_AMOUNT << (segment - 1);
+  }
+
+  // The index of the first value in `segment`
+  static constexpr size_t segment_start(size_t segment) noexcept {
+    return segment == 0 ? 0 : STATIC_AMOUNT << (segment - 1);
+  }
+
+  static constexpr size_t segment_of(size_t idx) noexcept {
+    return static_cast<size_t>(std::bit_width(idx / STATIC_AMOUNT));
+  }
+
+  // Returns `segment`, allocating it if we're the first to need it. If two
+  // threads get here at once, both allocate, one wins the CAS, and the other
+  // gives its block back
+  T *get_segment(size_t segment) {
+    if (segment == 0)
+      return get_arr_ptr();
+    T *block = segments_[segment].load(std::memory_order_acquire);
+    if (block != nullptr)
+      return block;
+    std::allocator<T> alloc;
+    T *fresh = AllocTraits::allocate(alloc, segment_capacity(segment));
+    if (segments_[segment].compare_exchange_strong(block, fresh,
+                                                   std::memory_order_acq_rel,
+                                                   std::memory_order_acquire))
+      return fresh;
+    AllocTraits::deallocate(alloc, fresh, segment_capacity(segment));
+    return block;
+  }
+
+  // Claims the next index, returning where its value goes. That's one
+  // fetch_add, so pushes don't retry against each other however many threads
+  // there are. But a claimed index can't be handed back, so if its segment
+  // can't be allocated there's no way to carry on, and (being noexcept) we
+  // std::terminate() instead of counting a value that'll never be there
+  T *claim_slot() noexcept {
+    const size_t idx = size_.fetch_add(1, std::memory_order_relaxed);
+    const size_t segment = segment_of(idx);
+    assert(segment < MAX_SEGMENTS);
+    return get_segment(segment) + (idx - segment_start(segment));
+  }
+
+  // Where the value at `idx` lives. Its segment must already exist
+  T *slot(size_t idx) const noexcept {
+    const size_t segment = segment_of(idx);
+    T *block = segment == 0
+                   ? get_arr_ptr()
+                   : segments_[segment].load(std::memory_order_acquire);
+    return block + (idx - segment_start(segment));
+  }
+
+  // Calls `fn(values, count)` for each segment holding values, in order, with
+  // the first `size` values
+  template <typename Fn> void for_each_block(size_t size, Fn fn) const {
+    for (size_t segment = 0; segment < MAX_SEGMENTS; ++segment) {
+      const size_t start = segment_start(segment);
+      if (start >= size)
+        break;
+      T *block = segment == 0
+                     ? get_arr_ptr()
+                     : segments_[segment].load(std::memory_order_acquire);
+      fn(block, std::min(segment_capacity(segment), size - start));
+    }
+  }
+
+  void free_segments() noexcept {
+    std::allocator<T> alloc;
+    for (size_t segment = 1; segment < MAX_SEGMENTS; ++segment) {
+      T *block = segments_[segment].exchange(nullptr);
+      if (block != nullptr)
+        AllocTraits::deallocate(alloc, block, segment_capacity(segment));
+    }
+  }
+
+  T *get_arr_ptr() const noexcept {
+    return const_cast<T *>(reinterpret_cast<const T *>(arr_));
+  }
+
+public:
+  using value_type = T;
+  using reference = T &;
+  using const_reference = const T &;
+  using size_type = size_t;
+
+  ConcurrentSmallVector() = default;
+
+  // Values never move, so neither can we
+  ConcurrentSmallVector(const ConcurrentSmallVector &) = delete;
+  ConcurrentSmallVector &operator=(const ConcurrentSmallVector &) = delete;
+
+  ~ConcurrentSmallVector() {
+    clear();
+    free_segments();
+  }
+
+  // ----- ELEMENT ACCESS -----
+  // The value at `idx`, which must have finished being pushed, and been
+  // synchronised with if another thread pushed it
+  T &operator[](size_t idx) noexcept {
+    assert(idx < size());
+    return *slot(idx);
+  }
+  const T &operator[](size_t idx) const noexcept {
+    assert(idx < size());
+    return *slot(idx);
+  }
+
+  // ----- CAPACITY -----
+  // How many values have been claimed, including any still being constructed
+  // by other threads
+  size_t size() const noexcept { return size_.load(std::memory_order_acquire); }
+  bool empty() const noexcept { return size() == 0; }
+
+  static constexpr size_t get_static_size() noexcept { return STATIC_AMOUNT; }
+
+  // ----- MODIFIERS -----
+  // Constructs a new value at the back. Safe to call from any number of
+  // threads at once. Returns a reference which stays valid until clear().
+  // Once an index is claimed there's no giving it back, so if the value's
+  // constructor can throw it's made first and then moved into place, and if
+  // it throws nothing is added. Running out of memory for a new segment
+  // calls std::terminate(), see claim_slot()
+  template <typename... Args> T &emplace_back(Args &&...args) {
+    if constexpr (std::is_nothrow_constructible_v<T, Args...>) {
+      return *std::construct_at(claim_slot(), std::forward<Args>(args)...);
+    } else {
+      static_assert(std::is_nothrow_move_constructible_v<T>,
+                    "T's constructor or move constructor must be noexcept");
+      T value(std::forward<Args>(args)...);
+      return *std::construct_at(claim_slot(), std::move(value));
+    }
+  }
+
+  T &push_back(const T &value) { return emplace_back(value); }
+  T &push_back(T &&value) { return emplace_back(std::move(value)); }
+
+  // Destroys every value, keeping the heap segments for reuse. Must not race
+  // with anything
+  void clear() noexcept {
+    for_each_block(size(), [](T *values, size_t count) {
+      std::destroy_n(values, count);
+    });
+    size_.store(0, std::memory_order_relaxed);
+  }
+
+  // Moves every value into a plain (contiguous) SmallVector, leaving us
+  // empty. Call once the appending is done, e.g. after joining the writers
+  template <size_t OUT_AMOUNT = STATIC_AMOUNT>
+  SmallVector<T, OUT_AMOUNT> freeze() {
+    SmallVector<T, OUT_AMOUNT> out;
+    out.reserve(size());
+    for_each_block(size(), [&out](T *values, size_t count) {
+      out.insert(out.end(), std::make_move_iterator(values),
+                 std::make_move_iterator(values + count));
+    });
+    clear();
+    free_segments();
+    return out;
+  }
+
+  // Calls `fn(std::span<T>)` for each segment's values in order, for reading
+  // them all in place without freeze()'s copy. Must not race with an append
+  template <typename Fn> void for_each_segment(Fn fn) {
+    for_each_block(size(), [&fn](T *values, size_t count) {
+      fn(std::span<T>(values, count));
+    });
+  }
+  template <typename Fn> void for_each_segment(Fn fn) const {
+    for_each_block(size(), [&fn](const T *values, size_t count) {
+      fn(std::span<const T>(values, count));
+    });
+  }
+};
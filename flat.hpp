@@ -0,0 +1,701 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "simd.hpp"
+#include "vec.hpp"
+
+// Sorted sets / maps kept in SmallVectors, for the many tiny maps (a handful
+// to a few dozen entries) where std::map / std::unordered_map spend more time
+// allocating nodes than searching. Lookups are a binary search, or a linear
+// (SIMD) scan when the keys are arithmetic and fit in a couple of cache lines.
+// Like std::flat_set / std::flat_map, inserting and erasing shuffle the values
+// after them along, and invalidate every iterator
+
+namespace flat {
+
+// Keys of arithmetic types compared with std::less are scanned linearly (see
+// simd.hpp) while they take up no more than this many bytes, which beats a
+// binary search's unpredictable branches / dependent loads
+inline constexpr size_t LINEAR_SEARCH_MAX_BYTES = 2 * CACHE_LINE_SIZE_BYTES;
+
+// True if `Compare` on `K` is just <, so equivalent keys are equal keys
+template <typename K, typename Compare>
+constexpr bool is_plain_less =
+    simd::Searchable<K> && (std::is_same_v<Compare, std::less<K>> ||
+                            std::is_same_v<Compare, std::less<>>);
+
+template <typename K, typename Compare>
+constexpr bool use_linear_search(size_t n) {
+  return is_plain_less<K, Compare> && n * sizeof(K) <= LINEAR_SEARCH_MAX_BYTES;
+}
+
+// Index of the first of the `n` sorted keys at `keys` for which
+// `before(keys[i])` is false. The binary search has no branches on the
+// comparison, it only picks between two offsets
+template <typename K, typename Compare, typename Before>
+constexpr size_t partition_point(const K *keys, size_t n, Before before) {
+  if (use_linear_search<K, Compare>(n)) {
+    // Counting is branchless too, and the compiler can vectorise it
+    size_t idx = 0;
+    for (size_t i = 0; i < n; ++i) {
+      idx += before(keys[i]) ? 1 : 0;
+    }
+    return idx;
+  }
+  const K *first = keys;
+  while (n > 0) {
+    const size_t half = n / 2;
+    first += before(first[half]) ? n - half : 0;
+    n = half;
+  }
+  return static_cast<size_t>(first - keys);
+}
+
+template <typename K, typename Compare>
+constexpr size_t lower_bound(const K *keys, size_t n, const K &key,
+                             const Compare &comp) {
+  return partition_point<K, Compare>(
+      keys, n, [&](const K &probe) { return comp(probe, key); });
+}
+
+template <typename K, typename Compare>
+constexpr size_t upper_bound(const K *keys, size_t n, const K &key,
+                             const Compare &comp) {
+  return partition_point<K, Compare>(
+      keys, n, [&](const K &probe) { return !comp(key, probe); });
+}
+
+// Index of the key equivalent to `key`, or `n` if there isn't one
+template <typename K, typename Compare>
+constexpr size_t find(const K *keys, size_t n, const K &key,
+                      const Compare &comp) {
+  if constexpr (is_plain_less<K, Compare>) {
+    if (use_linear_search<K, Compare>(n) && !std::is_constant_evaluated())
+      return simd::find(keys, n, key);
+  }
+  const size_t idx = lower_bound(keys, n, key, comp);
+  return (idx != n && !comp(key, keys[idx])) ? idx : n;
+}
+
+// Merges the sorted, unique keys in `extra` (none of which we have already)
+// into the first `n` keys of `keys`, which already has room for them all. We
+// go from the back, so nothing is overwritten before it has been moved on.
+// `move_to(from, to)` / `move_from_extra(from, to)` move one entry
+template <typename K, typename Compare, typename MoveTo, typename MoveFromExtra>
+constexpr void merge_back(const K *keys, size_t n, const K *extra,
+                          size_t extra_count, const Compare &comp,
+                          MoveTo move_to, MoveFromExtra move_from_extra) {
+  size_t to = n + extra_count;
+  while (extra_count > 0) {
+    --to;
+    if (n > 0 && comp(extra[extra_count - 1], keys[n - 1])) {
+      move_to(--n, to);
+    } else {
+      move_from_extra(--extra_count, to);
+    }
+  }
+}
+
+} // namespace flat
+
+// A sorted set of unique keys, kept in a SmallVector<K, STATIC_AMOUNT>
+template <typename K, size_t STATIC_AMOUNT = calculate_static_size(sizeof(K)),
+          typename Compare = std::less<K>>
+class SmallFlatSet {
+public:
+  using key_type = K;
+  using value_type = K;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using reference = const K &;
+  using const_reference = const K &;
+  // Keys can't be changed in place, as that could break the ordering
+  using iterator = const K *;
+  using const_iterator = const K *;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using container_type = SmallVector<K, STATIC_AMOUNT>;
+
+private:
+  container_type keys_;
+  [[no_unique_address]] Compare comp_;
+
+  constexpr bool equivalent(const K &a, const K &b) const {
+    return !comp_(a, b) && !comp_(b, a);
+  }
+
+  constexpr size_t find_index(const K &key) const {
+    return flat::find(keys_.data(), keys_.size(), key, comp_);
+  }
+
+  // Sorts the keys from `old_size` onwards (just added by a bulk insert),
+  // drops the ones we already had, and merges the rest in
+  constexpr void merge_tail(size_t old_size) {
+    auto old_end = keys_.begin() + old_size;
+    std::sort(old_end, keys_.end(), comp_);
+    auto new_end = std::unique(
+        old_end, keys_.end(),
+        [this](const K &a, const K &b) { return equivalent(a, b); });
+    if (old_size != 0) {
+      new_end = std::remove_if(old_end, new_end, [&](const K &key) {
+        return flat::find(keys_.data(), old_size, key, comp_) != old_size;
+      });
+    }
+    keys_.erase(new_end, keys_.end());
+
+    const size_t extra_count = keys_.size() - old_size;
+    if (extra_count == 0 || old_size == 0 ||
+        comp_(keys_[old_size - 1], keys_[old_size]))
+      return; // Already in order, e.g. the new keys all go on the end
+
+    container_type extra;
+    extra.insert(extra.end(), std::make_move_iterator(old_end),
+                 std::make_move_iterator(keys_.end()));
+    flat::merge_back(
+        keys_.data(), old_size, extra.data(), extra_count, comp_,
+        [this](size_t from, size_t to) { keys_[to] = std::move(keys_[from]); },
+        [&](size_t from, size_t to) { keys_[to] = std::move(extra[from]); });
+  }
+
+public:
+  constexpr SmallFlatSet() = default;
+
+  constexpr explicit SmallFlatSet(const Compare &comp) : comp_(comp) {}
+
+  template <std::input_iterator It>
+  constexpr SmallFlatSet(It first, It last, const Compare &comp = Compare())
+      : comp_(comp) {
+    insert(first, last);
+  }
+
+  constexpr SmallFlatSet(std::initializer_list<K> init,
+                         const Compare &comp = Compare())
+      : SmallFlatSet(init.begin(), init.end(), comp) {}
+
+  // ----- ITERATORS -----
+  constexpr const_iterator begin() const noexcept { return keys_.data(); }
+  constexpr const_iterator end() const noexcept {
+    return keys_.data() + keys_.size();
+  }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+  constexpr const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator(end());
+  }
+  constexpr const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator(begin());
+  }
+
+  // ----- CAPACITY -----
+  constexpr bool empty() const noexcept { return keys_.empty(); }
+  constexpr size_t size() const noexcept { return keys_.size(); }
+  constexpr size_t capacity() const noexcept { return keys_.capacity(); }
+  constexpr void reserve(size_t size) { keys_.reserve(size); }
+
+  // ----- MODIFIERS -----
+  constexpr void clear() noexcept { keys_.clear(); }
+
+  // Inserts `key` if we don't have it already. Returns the iterator to the
+  // key, and whether it was inserted
+  constexpr std::pair<iterator, bool> insert(const K &key) {
+    return emplace(key);
+  }
+  constexpr std::pair<iterator, bool> insert(K &&key) {
+    return emplace(std::move(key));
+  }
+
+  template <typename... Args>
+  constexpr std::pair<iterator, bool> emplace(Args &&...args) {
+    K key(std::forward<Args>(args)...);
+    const size_t idx =
+        flat::lower_bound(keys_.data(), keys_.size(), key, comp_);
+    if (idx != keys_.size() && !comp_(key, keys_[idx]))
+      return {begin() + idx, false};
+    keys_.insert(keys_.begin() + idx, std::move(key));
+    return {begin() + idx, true};
+  }
+
+  // Inserts every key from `first` to `last` that we don't have already. The
+  // keys are added to the back in one go, sorted there, and then merged in,
+  // rather than being inserted (and shuffling everything after them) one by
+  // one. Of equivalent keys, the one we had already / came first is kept
+  template <std::input_iterator It>
+  constexpr void insert(It first, It last) {
+    const size_t old_size = keys_.size();
+    keys_.insert(keys_.end(), first, last);
+    merge_tail(old_size);
+  }
+
+  constexpr void insert(std::initializer_list<K> init) {
+    insert(init.begin(), init.end());
+  }
+
+  constexpr iterator erase(const_iterator pos) {
+    const size_t idx = static_cast<size_t>(pos - cbegin());
+    keys_.erase(keys_.begin() + idx);
+    return begin() + idx;
+  }
+  constexpr iterator erase(const_iterator first, const_iterator last) {
+    const size_t first_idx = static_cast<size_t>(first - cbegin());
+    const size_t last_idx = static_cast<size_t>(last - cbegin());
+    keys_.erase(keys_.begin() + first_idx, keys_.begin() + last_idx);
+    return begin() + first_idx;
+  }
+  // Removes `key` if we have it, returning how many keys were removed
+  constexpr size_t erase(const K &key) {
+    const size_t idx = find_index(key);
+    if (idx == keys_.size())
+      return 0;
+    keys_.erase(keys_.begin() + idx);
+    return 1;
+  }
+
+  constexpr void swap(SmallFlatSet &other) {
+    using std::swap;
+    keys_.swap(other.keys_);
+    swap(comp_, other.comp_);
+  }
+
+  // ----- LOOKUP -----
+  constexpr const_iterator find(const K &key) const {
+    return begin() + find_index(key);
+  }
+  constexpr bool contains(const K &key) const {
+    return find_index(key) != keys_.size();
+  }
+  constexpr size_t count(const K &key) const { return contains(key) ? 1 : 0; }
+
+  constexpr const_iterator lower_bound(const K &key) const {
+    return begin() + flat::lower_bound(keys_.data(), keys_.size(), key, comp_);
+  }
+  constexpr const_iterator upper_bound(const K &key) const {
+    return begin() + flat::upper_bound(keys_.data(), keys_.size(), key, comp_);
+  }
+  constexpr std::pair<const_iterator, const_iterator>
+  equal_range(const K &key) const {
+    const const_iterator first = lower_bound(key);
+    if (first == end() || comp_(key, *first))
+      return {first, first};
+    return {first, first + 1};
+  }
+
+  // ----- OBSERVERS -----
+  constexpr key_compare key_comp() const { return comp_; }
+  // The sorted keys
+  constexpr const container_type &keys() const noexcept { return keys_; }
+
+  constexpr bool operator==(const SmallFlatSet &other) const {
+    return keys_.size() == other.keys_.size() &&
+           std::equal(begin(), end(), other.begin());
+  }
+};
+
+// A sorted map of unique keys to values. The keys and the values are kept in
+// two SmallVectors (like std::flat_map), so lookups only touch the keys, and
+// arithmetic keys can be scanned a register at a time. The iterators give
+// std::pair<const K &, V &> rather than a reference to a stored pair
+template <typename K, typename V,
+          size_t STATIC_AMOUNT = calculate_static_size(
+              sizeof(K) + sizeof(V), 2 * header_size_bytes(),
+              2 * CACHE_LINE_SIZE_BYTES),
+          typename Compare = std::less<K>>
+class SmallFlatMap {
+private:
+  template <bool CONST> class Iterator {
+  private:
+    friend class SmallFlatMap;
+    template <bool> friend class Iterator;
+    using ValuePtr = std::conditional_t<CONST, const V *, V *>;
+
+    const K *key_ = nullptr;
+    ValuePtr value_ = nullptr;
+
+    constexpr Iterator(const K *key, ValuePtr value)
+        : key_(key), value_(value) {}
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::pair<K, V>;
+    using difference_type = ptrdiff_t;
+    using reference = std::pair<const K &, std::remove_pointer_t<ValuePtr> &>;
+    // operator-> needs something to point at, so it hands out one of these
+    struct pointer {
+      reference ref;
+      constexpr const reference *operator->() const { return &ref; }
+    };
+
+    constexpr Iterator() = default;
+    // Lets an iterator be turned into a const_iterator
+    template <bool OTHER_CONST>
+      requires(CONST && !OTHER_CONST)
+    constexpr Iterator(const Iterator<OTHER_CONST> &other)
+        : key_(other.key_), value_(other.value_) {}
+
+    constexpr reference operator*() const { return {*key_, *value_}; }
+    constexpr pointer operator->() const { return {**this}; }
+    constexpr reference operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    constexpr Iterator &operator++() {
+      ++key_;
+      ++value_;
+      return *this;
+    }
+    constexpr Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+    constexpr Iterator &operator--() {
+      --key_;
+      --value_;
+      return *this;
+    }
+    constexpr Iterator operator--(int) {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+    constexpr Iterator &operator+=(difference_type n) {
+      key_ += n;
+      value_ += n;
+      return *this;
+    }
+    constexpr Iterator &operator-=(difference_type n) { return *this += -n; }
+    constexpr Iterator operator+(difference_type n) const {
+      return Iterator(key_ + n, value_ + n);
+    }
+    friend constexpr Iterator operator+(difference_type n, Iterator it) {
+      return it + n;
+    }
+    constexpr Iterator operator-(difference_type n) const {
+      return Iterator(key_ - n, value_ - n);
+    }
+    constexpr difference_type operator-(const Iterator &other) const {
+      return key_ - other.key_;
+    }
+
+    constexpr bool operator==(const Iterator &other) const {
+      return key_ == other.key_;
+    }
+    constexpr auto operator<=>(const Iterator &other) const {
+      return key_ <=> other.key_;
+    }
+  };
+
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<K, V>;
+  using key_compare = Compare;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using reference = std::pair<const K &, V &>;
+  using const_reference = std::pair<const K &, const V &>;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using key_container_type = SmallVector<K, STATIC_AMOUNT>;
+  using mapped_container_type = SmallVector<V, STATIC_AMOUNT>;
+
+private:
+  key_container_type keys_;
+  mapped_container_type values_;
+  [[no_unique_address]] Compare comp_;
+
+  constexpr iterator iterator_at(size_t idx) {
+    return iterator(keys_.data() + idx, values_.data() + idx);
+  }
+  constexpr const_iterator iterator_at(size_t idx) const {
+    return const_iterator(keys_.data() + idx, values_.data() + idx);
+  }
+
+  constexpr size_t find_index(const K &key) const {
+    return flat::find(keys_.data(), keys_.size(), key, comp_);
+  }
+
+  // try_emplace() for both const K & and K &&
+  template <typename KeyArg, typename... Args>
+  constexpr std::pair<iterator, bool> emplace_key(KeyArg &&key,
+                                                  Args &&...args) {
+    const size_t idx =
+        flat::lower_bound(keys_.data(), keys_.size(), key, comp_);
+    if (idx != keys_.size() && !comp_(key, keys_[idx]))
+      return {iterator_at(idx), false};
+    // The value goes in first, and comes out again if the key can't go in,
+    // so keys_ and values_ never get out of step
+    values_.emplace(values_.begin() + idx, std::forward<Args>(args)...);
+    try {
+      keys_.emplace(keys_.begin() + idx, std::forward<KeyArg>(key));
+    } catch (...) {
+      values_.erase(values_.begin() + idx);
+      throw;
+    }
+    return {iterator_at(idx), true};
+  }
+
+  // Sorts the entries from `old_size` onwards (just added by a bulk insert),
+  // drops the ones whose keys we already had, and merges the rest in. The
+  // keys and values are in separate SmallVectors, so we sort indices to them
+  constexpr void merge_tail(size_t old_size) {
+    SmallVector<size_t, STATIC_AMOUNT> order;
+    order.reserve(keys_.size() - old_size);
+    for (size_t i = old_size; i < keys_.size(); ++i) {
+      order.push_back(i);
+    }
+    // Ties go by index, so the first of equivalent keys comes first
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return comp_(keys_[a], keys_[b]) ||
+             (!comp_(keys_[b], keys_[a]) && a < b);
+    });
+
+    key_container_type extra_keys;
+    mapped_container_type extra_values;
+    extra_keys.reserve(order.size());
+    extra_values.reserve(order.size());
+    for (const size_t idx : order) {
+      const K &key = keys_[idx];
+      if (!extra_keys.empty() && !comp_(extra_keys.back(), key))
+        continue;
+      if (old_size != 0 &&
+          flat::find(keys_.data(), old_size, key, comp_) != old_size)
+        continue;
+      extra_keys.push_back(std::move(keys_[idx]));
+      extra_values.push_back(std::move(values_[idx]));
+    }
+
+    const size_t extra_count = extra_keys.size();
+    keys_.erase(keys_.begin() + old_size + extra_count, keys_.end());
+    values_.erase(values_.begin() + old_size + extra_count, values_.end());
+    if (extra_count == 0)
+      return;
+    flat::merge_back(
+        keys_.data(), old_size, extra_keys.data(), extra_count, comp_,
+        [this](size_t from, size_t to) {
+          keys_[to] = std::move(keys_[from]);
+          values_[to] = std::move(values_[from]);
+        },
+        [&](size_t from, size_t to) {
+          keys_[to] = std::move(extra_keys[from]);
+          values_[to] = std::move(extra_values[from]);
+        });
+  }
+
+public:
+  constexpr SmallFlatMap() = default;
+
+  constexpr explicit SmallFlatMap(const Compare &comp) : comp_(comp) {}
+
+  template <std::input_iterator It>
+  constexpr SmallFlatMap(It first, It last, const Compare &comp = Compare())
+      : comp_(comp) {
+    insert(first, last);
+  }
+
+  constexpr SmallFlatMap(std::initializer_list<value_type> init,
+                         const Compare &comp = Compare())
+      : SmallFlatMap(init.begin(), init.end(), comp) {}
+
+  // ----- ELEMENT ACCESS -----
+  constexpr V &at(const K &key) {
+    const size_t idx = find_index(key);
+    if (idx == keys_.size())
+      throw std::out_of_range("Key not in SmallFlatMap");
+    return values_[idx];
+  }
+  constexpr const V &at(const K &key) const {
+    const size_t idx = find_index(key);
+    if (idx == keys_.size())
+      throw std::out_of_range("Key not in SmallFlatMap");
+    return values_[idx];
+  }
+
+  // Returns the value for `key`, value-initialising one if there isn't one
+  constexpr V &operator[](const K &key) {
+    return (*try_emplace(key).first).second;
+  }
+  constexpr V &operator[](K &&key) {
+    return (*try_emplace(std::move(key)).first).second;
+  }
+
+  // ----- ITERATORS -----
+  constexpr iterator begin() noexcept { return iterator_at(0); }
+  constexpr const_iterator begin() const noexcept { return iterator_at(0); }
+  constexpr iterator end() noexcept { return iterator_at(keys_.size()); }
+  constexpr const_iterator end() const noexcept {
+    return iterator_at(keys_.size());
+  }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+  constexpr reverse_iterator rbegin() noexcept {
+    return reverse_iterator(end());
+  }
+  constexpr const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator(end());
+  }
+  constexpr reverse_iterator rend() noexcept {
+    return reverse_iterator(begin());
+  }
+  constexpr const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator(begin());
+  }
+
+  // ----- CAPACITY -----
+  constexpr bool empty() const noexcept { return keys_.empty(); }
+  constexpr size_t size() const noexcept { return keys_.size(); }
+  constexpr size_t capacity() const noexcept { return keys_.capacity(); }
+  constexpr void reserve(size_t size) {
+    keys_.reserve(size);
+    values_.reserve(size);
+  }
+
+  // ----- MODIFIERS -----
+  constexpr void clear() noexcept {
+    keys_.clear();
+    values_.clear();
+  }
+
+  // Inserts `key` with a value made from `args` if we don't have it already,
+  // otherwise leaves `args` alone. Returns the iterator to the entry, and
+  // whether it was inserted
+  template <typename... Args>
+  constexpr std::pair<iterator, bool> try_emplace(const K &key,
+                                                  Args &&...args) {
+    return emplace_key(key, std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  constexpr std::pair<iterator, bool> try_emplace(K &&key, Args &&...args) {
+    return emplace_key(std::move(key), std::forward<Args>(args)...);
+  }
+
+  constexpr std::pair<iterator, bool> insert(const value_type &entry) {
+    return try_emplace(entry.first, entry.second);
+  }
+  constexpr std::pair<iterator, bool> insert(value_type &&entry) {
+    return try_emplace(std::move(entry.first), std::move(entry.second));
+  }
+
+  // Like try_emplace(), but assigns `value` to the entry if we already have
+  // `key`
+  template <typename M>
+  constexpr std::pair<iterator, bool> insert_or_assign(const K &key,
+                                                       M &&value) {
+    auto [it, inserted] = try_emplace(key, std::forward<M>(value));
+    if (!inserted)
+      (*it).second = std::forward<M>(value);
+    return {it, inserted};
+  }
+
+  // Inserts every entry from `first` to `last` whose key we don't have
+  // already. They are added to the back in one go, sorted there, and then
+  // merged in, rather than being inserted (and shuffling everything after
+  // them) one by one. Of equivalent keys, the one we had already / came first
+  // is kept
+  template <std::input_iterator It>
+  constexpr void insert(It first, It last) {
+    const size_t old_size = keys_.size();
+    if constexpr (std::forward_iterator<It>)
+      reserve(old_size + static_cast<size_t>(std::distance(first, last)));
+    try {
+      for (; first != last; ++first) {
+        const auto &entry = *first;
+        keys_.emplace_back(entry.first);
+        values_.emplace_back(entry.second);
+      }
+    } catch (...) {
+      // Drop everything we added, so keys_ and values_ are in step again
+      keys_.erase(keys_.begin() + old_size, keys_.end());
+      values_.erase(values_.begin() + old_size, values_.end());
+      throw;
+    }
+    merge_tail(old_size);
+  }
+
+  constexpr void insert(std::initializer_list<value_type> init) {
+    insert(init.begin(), init.end());
+  }
+
+  constexpr iterator erase(const_iterator pos) {
+    const size_t idx = static_cast<size_t>(pos - cbegin());
+    keys_.erase(keys_.begin() + idx);
+    values_.erase(values_.begin() + idx);
+    return iterator_at(idx);
+  }
+  constexpr iterator erase(const_iterator first, const_iterator last) {
+    const size_t first_idx = static_cast<size_t>(first - cbegin());
+    const size_t last_idx = static_cast<size_t>(last - cbegin());
+    keys_.erase(keys_.begin() + first_idx, keys_.begin() + last_idx);
+    values_.erase(values_.begin() + first_idx, values_.begin() + last_idx);
+    return iterator_at(first_idx);
+  }
+  // Removes the entry for `key` if we have one, returning how many entries
+  // were removed
+  constexpr size_t erase(const K &key) {
+    const size_t idx = find_index(key);
+    if (idx == keys_.size())
+      return 0;
+    erase(cbegin() + static_cast<ptrdiff_t>(idx));
+    return 1;
+  }
+
+  constexpr void swap(SmallFlatMap &other) {
+    using std::swap;
+    keys_.swap(other.keys_);
+    values_.swap(other.values_);
+    swap(comp_, other.comp_);
+  }
+
+  // ----- LOOKUP -----
+  constexpr iterator find(const K &key) { return iterator_at(find_index(key)); }
+  constexpr const_iterator find(const K &key) const {
+    return iterator_at(find_index(key));
+  }
+  constexpr bool contains(const K &key) const {
+    return find_index(key) != keys_.size();
+  }
+  constexpr size_t count(const K &key) const { return contains(key) ? 1 : 0; }
+
+  constexpr iterator lower_bound(const K &key) {
+    return iterator_at(
+        flat::lower_bound(keys_.data(), keys_.size(), key, comp_));
+  }
+  constexpr const_iterator lower_bound(const K &key) const {
+    return iterator_at(
+        flat::lower_bound(keys_.data(), keys_.size(), key, comp_));
+  }
+  constexpr iterator upper_bound(const K &key) {
+    return iterator_at(
+        flat::upper_bound(keys_.data(), keys_.size(), key, comp_));
+  }
+  constexpr const_iterator upper_bound(const K &key) const {
+    return iterator_at(
+        flat::upper_bound(keys_.data(), keys_.size(), key, comp_));
+  }
+
+  // ----- OBSERVERS -----
+  constexpr key_compare key_comp() const { return comp_; }
+  // The sorted keys, and the values in the same order
+  constexpr const key_container_type &keys() const noexcept { return keys_; }
+  constexpr const mapped_container_type &values() const noexcept {
+    return values_;
+  }
+
+  constexpr bool operator==(const SmallFlatMap &other) const {
+    return keys_.size() == other.keys_.size() &&
+           std::equal(keys_.begin(), keys_.end(), other.keys_.begin()) &&
+           std::equal(values_.begin(), values_.end(), other.values_.begin());
+  }
+};
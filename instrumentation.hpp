@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "vec.hpp"
+
+// Counts for one instrumented site, shared by every SmallVector using its tag.
+// Everything is a relaxed atomic, so SmallVectors on any thread can update it
+class SpillStats {
+public:
+  // Sizes below LINEAR_BUCKETS get a bucket each, bigger sizes go into power
+  // of two buckets [2^k, 2^(k+1))
+  static constexpr size_t LINEAR_BUCKETS = 64;
+  static constexpr size_t BUCKETS =
+      LINEAR_BUCKETS + 64 - std::countr_zero(LINEAR_BUCKETS);
+
+  std::atomic<uint64_t> spillovers{0};
+  std::atomic<uint64_t> reallocations{0};
+  std::atomic<uint64_t> relocated_values{0};
+  std::atomic<uint64_t> releases{0};
+  std::atomic<uint64_t> peak_size{0};
+  std::atomic<uint64_t> peak_capacity{0};
+  // How many SmallVectors had each size as their high-water mark, by the time
+  // they were cleared or destroyed
+  std::array<std::atomic<uint64_t>, BUCKETS> size_histogram{};
+
+  static constexpr size_t bucket_of(size_t size) noexcept {
+    if (size < LINEAR_BUCKETS)
+      return size;
+    return LINEAR_BUCKETS + static_cast<size_t>(std::bit_width(size)) -
+           std::bit_width(LINEAR_BUCKETS);
+  }
+
+  // The biggest size that goes into `bucket`
+  static constexpr size_t bucket_max(size_t bucket) noexcept {
+    if (bucket < LINEAR_BUCKETS)
+      return bucket;
+    const size_t shift =
+        bucket - LINEAR_BUCKETS + std::bit_width(LINEAR_BUCKETS);
+    return shift >= 64 ? SIZE_MAX : (size_t{1} << shift) - 1;
+  }
+
+  void record_allocation(size_t capacity) noexcept {
+    update_max(peak_capacity, capacity);
+  }
+
+  // Only has to write when `size` is a new peak, so a SmallVector growing
+  // past sizes we've already seen costs just a relaxed load per push
+  void record_size(size_t size) noexcept { update_max(peak_size, size); }
+
+  // A SmallVector which held at most `peak` values was released
+  void record_release(size_t peak) noexcept {
+    releases.fetch_add(1, std::memory_order_relaxed);
+    size_histogram[bucket_of(peak)].fetch_add(1, std::memory_order_relaxed);
+    update_max(peak_size, peak);
+  }
+
+  // The smallest size which at least `percent` % of the releases were at or
+  // below. Sizes past LINEAR_BUCKETS are rounded up to the top of their bucket
+  size_t percentile(double percent) const noexcept {
+    const uint64_t total = releases.load(std::memory_order_relaxed);
+    if (total == 0)
+      return 0;
+    const auto wanted = static_cast<uint64_t>(std::ceil(
+        static_cast<double>(total) * std::clamp(percent, 0.0, 100.0) / 100.0));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+      seen += size_histogram[bucket].load(std::memory_order_relaxed);
+      if (seen >= wanted && seen != 0)
+        return std::min<size_t>(bucket_max(bucket),
+                                peak_size.load(std::memory_order_relaxed));
+    }
+    return peak_size.load(std::memory_order_relaxed);
+  }
+
+  void reset() noexcept {
+    for (auto *counter : {&spillovers, &reallocations, &relocated_values,
+                          &releases, &peak_size, &peak_capacity}) {
+      counter->store(0, std::memory_order_relaxed);
+    }
+    for (auto &bucket : size_histogram) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void dump(std::ostream &os, std::string_view name) const {
+    os << name << ": spillovers=" << spillovers.load()
+       << " reallocations=" << reallocations.load()
+       << " relocated_values=" << relocated_values.load()
+       << " releases=" << releases.load() << " peak_size=" << peak_size.load()
+       << " peak_capacity=" << peak_capacity.load() << " p50=" << percentile(50)
+       << " p95=" << percentile(95) << " p99=" << percentile(99) << '\n';
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+      const uint64_t count = size_histogram[bucket].load();
+      if (count == 0)
+        continue;
+      os << "  size ";
+      if (bucket < LINEAR_BUCKETS) {
+        os << bucket;
+      } else {
+        os << bucket_max(bucket - 1) + 1 << '-' << bucket_max(bucket);
+      }
+      os << ": " << count << '\n';
+    }
+  }
+
+private:
+  static void update_max(std::atomic<uint64_t> &max, uint64_t value) noexcept {
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (current < value &&
+           !max.compare_exchange_weak(current, value,
+                                      std::memory_order_relaxed)) {
+    }
+  }
+};
+
+// Every SpillStats in use, so they can all be dumped at shutdown
+class SpillStatsRegistry {
+private:
+  struct Entry {
+    std::string_view name;
+    SpillStats stats;
+  };
+
+  std::mutex mutex_;
+  std::list<Entry> entries_; // A list so the entries never move
+
+public:
+  static SpillStatsRegistry &instance() {
+    static SpillStatsRegistry registry;
+    return registry;
+  }
+
+  SpillStats &add(std::string_view name) {
+    std::lock_guard lock(mutex_);
+    return entries_.emplace_back(name).stats;
+  }
+
+  // Calls `fn(name, stats)` for every site
+  template <typename Fn> void for_each(Fn fn) {
+    std::lock_guard lock(mutex_);
+    for (const Entry &entry : entries_) {
+      fn(entry.name, entry.stats);
+    }
+  }
+
+  void dump_all(std::ostream &os) {
+    for_each([&os](std::string_view name, const SpillStats &stats) {
+      stats.dump(os, name);
+    });
+  }
+};
+
+// An Instrumentation policy which counts into the SpillStats for `Tag`. Tag
+// names the site, e.g.
+//
+//   struct TokenSite {
+//     static constexpr std::string_view name = "parser.tokens";
+//   };
+template <typename Tag> struct CountingInstrumentation {
+  static SpillStats &stats() {
+    static SpillStats &stats = SpillStatsRegistry::instance().add(Tag::name);
+    return stats;
+  }
+
+  static void on_spillover(size_t capacity, size_t) noexcept {
+    stats().spillovers.fetch_add(1, std::memory_order_relaxed);
+    stats().record_allocation(capacity);
+  }
+  static void on_reallocation(size_t capacity, size_t) noexcept {
+    stats().reallocations.fetch_add(1, std::memory_order_relaxed);
+    stats().record_allocation(capacity);
+  }
+  static void on_relocate(size_t count) noexcept {
+    stats().relocated_values.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  // The histogram has to count the most each SmallVector ever held, not
+  // whatever it was left with, so we keep track of that per SmallVector
+  void on_size(size_t size) noexcept {
+    if (size > high_water_) {
+      high_water_ = size;
+      stats().record_size(size);
+    }
+  }
+  void on_release(size_t size) noexcept {
+    const size_t peak = std::max(high_water_, size);
+    high_water_ = 0;
+    if (peak != 0)
+      stats().record_release(peak);
+  }
+
+private:
+  size_t high_water_ = 0;
+};
+
+// The instrumentation for the site `Tag`, which is only switched on when
+// SMALLVECTOR_INSTRUMENT is defined, so release builds pay nothing for it
+#ifdef SMALLVECTOR_INSTRUMENT
+template <typename Tag>
+using SiteInstrumentation = CountingInstrumentation<Tag>;
+#else
+template <typename Tag> using SiteInstrumentation = NoInstrumentation;
+#endif
+
+// ----- PROFILE GUIDED STATIC SIZES -----
+// 1. Use InstrumentedSmallVector for the sites you want to tune, build with
+//    SMALLVECTOR_INSTRUMENT defined, and do a representative run which calls
+//    write_profiled_sizes() at the end
+// 2. Build again with SMALLVECTOR_PROFILED_SIZES_HEADER defined as the path
+//    of the header it wrote, e.g. -DSMALLVECTOR_PROFILED_SIZES_HEADER='"a.hpp"'
+// Each site then gets its profiled size (rounded up to fill the cache line)
+// as its STATIC_AMOUNT, instead of the calculate_static_size() guess
+
+// The size wanted for the site named `site`
+struct ProfiledSize {
+  std::string_view site;
+  size_t size;
+};
+
+#ifdef SMALLVECTOR_PROFILED_SIZES_HEADER
+#include SMALLVECTOR_PROFILED_SIZES_HEADER
+#else
+inline constexpr std::array<ProfiledSize, 0> PROFILED_SIZES{};
+#endif
+
+// The STATIC_AMOUNT for the site named `site` holding values of
+// `size_of_t` bytes. Uses the profiled size if there is one, else falls back
+// to calculate_static_size()
+consteval size_t
+profiled_static_size(std::string_view site, const size_t size_of_t,
+                     const size_t header_bytes = header_size_bytes()) {
+  for (const ProfiledSize &profiled : PROFILED_SIZES) {
+    if (profiled.site == site)
+      return calculate_static_size_for(profiled.size, size_of_t, header_bytes);
+  }
+  return calculate_static_size(size_of_t, header_bytes);
+}
+
+// A SmallVector whose spills are counted against `Tag` when
+// SMALLVECTOR_INSTRUMENT is defined, and whose STATIC_AMOUNT comes from the
+// profiled sizes if we have them
+template <typename Tag, typename T,
+          size_t STATIC_AMOUNT = profiled_static_size(Tag::name, sizeof(T))>
+using InstrumentedSmallVector =
+    SmallVector<T, STATIC_AMOUNT, size_t, std::allocator<T>, GrowBy2,
+                SiteInstrumentation<Tag>>;
+
+// Writes the stats for every instrumented site to `os`
+inline void dump_spill_stats(std::ostream &os) {
+  SpillStatsRegistry::instance().dump_all(os);
+}
+
+// Writes a header for SMALLVECTOR_PROFILED_SIZES_HEADER to `os`, giving each
+// site which recorded anything the size that `percent` % of its SmallVectors
+// fit in
+inline void write_profiled_sizes(std::ostream &os, double percent = 95) {
+  std::vector<std::pair<std::string_view, size_t>> sizes;
+  SpillStatsRegistry::instance().for_each(
+      [&](std::string_view name, const SpillStats &stats) {
+        if (stats.releases.load() != 0)
+          sizes.emplace_back(name, stats.percentile(percent));
+      });
+
+  os << "// Generated by write_profiled_sizes() from a profiled run (p"
+     << percent << "), don't edit\n"
+     << "// Only include this through SMALLVECTOR_PROFILED_SIZES_HEADER\n"
+     << "#pragma once\n\n"
+     << "inline constexpr std::array<ProfiledSize, " << sizes.size()
+     << "> PROFILED_SIZES{{\n";
+  for (const auto &[name, size] : sizes) {
+    os << "    {\"";
+    for (const char c : name) {
+      if (c == '"' || c == '\\')
+        os << '\\';
+      os << c;
+    }
+    os << "\", " << size << "},\n";
+  }
+  os << "}};\n";
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+#if __has_include(<sys/mman.h>) && __has_include(<fcntl.h>) &&                \
+    __has_include(<unistd.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#define SMALLVECTOR_HAS_MMAP 1
+#endif
+
+#include "serialize.hpp"
+#include "simd.hpp"
+#include "vec.hpp"
+
+// A read-only view of `size` values owned by someone else, e.g. a section of
+// an mmap()ed file, a SmallVector, or a std::vector. It has SmallVector's read
+// API, but never copies or frees the values, so it's only valid as long as
+// they are
+template <typename T> class SmallVectorRef {
+private:
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+
+  constexpr size_t find_index(const T &value) const {
+    if constexpr (simd::Searchable<T>) {
+      if (!std::is_constant_evaluated())
+        return simd::find(data_, size_, value);
+    }
+    return static_cast<size_t>(std::find(data_, data_ + size_, value) - data_);
+  }
+
+public:
+  using value_type = T;
+  using reference = const T &;
+  using const_reference = const T &;
+  using iterator = const T *;
+  using const_iterator = const T *;
+  using reverse_iterator = std::reverse_iterator<const_iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using size_type = size_t;
+
+  constexpr SmallVectorRef() noexcept = default;
+  constexpr SmallVectorRef(const T *data, size_t size) noexcept
+      : data_(data), size_(size) {}
+  constexpr SmallVectorRef(std::span<const T> values) noexcept
+      : data_(values.data()), size_(values.size()) {}
+  // Any SmallVector of T, whatever its STATIC_AMOUNT
+  template <typename... Rest>
+  constexpr SmallVectorRef(const SmallVectorImpl<T, Rest...> &v) noexcept
+      : data_(v.data()), size_(v.size()) {}
+
+  // Views the vector serialized at the front of `bytes` (see serialize.hpp)
+  // in place. `bytes` is moved past it, so calling this again reads the next
+  // one. The payload must be aligned for T
+  static SmallVectorRef read_wire(std::span<const std::byte> &bytes)
+    requires std::is_trivially_copyable_v<T>
+  {
+    const uint64_t count = read_wire_prefix(bytes);
+    if (count > (bytes.size() - WIRE_PREFIX_BYTES) / sizeof(T))
+      throw std::out_of_range("Truncated SmallVector payload");
+    const std::byte *payload = bytes.data() + WIRE_PREFIX_BYTES;
+    if (reinterpret_cast<uintptr_t>(payload) % alignof(T) != 0)
+      throw std::invalid_argument("SmallVector payload isn't aligned for T");
+    const auto size = static_cast<size_t>(count);
+    bytes = bytes.subspan(WIRE_PREFIX_BYTES + size * sizeof(T));
+    return SmallVectorRef(reinterpret_cast<const T *>(payload), size);
+  }
+
+  // ----- ELEMENT ACCESS -----
+  constexpr const T &at(size_t idx) const {
+    if (idx >= size_)
+      throw std::out_of_range("Out of range access");
+    return data_[idx];
+  }
+  constexpr const T &operator[](size_t idx) const noexcept {
+    return data_[idx];
+  }
+  constexpr const T &front() const noexcept { return data_[0]; }
+  constexpr const T &back() const noexcept { return data_[size_ - 1]; }
+  constexpr const T *data() const noexcept { return data_; }
+
+  // ----- ITERATORS -----
+  constexpr const_iterator begin() const noexcept { return data_; }
+  constexpr const_iterator end() const noexcept { return data_ + size_; }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+  constexpr const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator(end());
+  }
+  constexpr const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator(begin());
+  }
+
+  // ----- CAPACITY -----
+  constexpr bool empty() const noexcept { return size_ == 0; }
+  constexpr size_t size() const noexcept { return size_; }
+
+  // ----- HELPFUL FUNCTIONS -----
+  constexpr const_iterator find(const T &value) const {
+    return data_ + find_index(value);
+  }
+  constexpr bool contains(const T &value) const {
+    return find_index(value) != size_;
+  }
+  constexpr size_t count(const T &value) const {
+    if constexpr (simd::Searchable<T>) {
+      if (!std::is_constant_evaluated())
+        return simd::count(data_, size_, value);
+    }
+    return static_cast<size_t>(std::count(data_, data_ + size_, value));
+  }
+
+  constexpr std::span<const T> as_span() const noexcept {
+    return {data_, size_};
+  }
+  std::span<const std::byte> as_bytes() const noexcept
+    requires std::is_trivially_copyable_v<T>
+  {
+    return std::as_bytes(as_span());
+  }
+
+  constexpr bool operator==(const SmallVectorRef &other) const {
+    if (size_ != other.size_)
+      return false;
+    if constexpr (simd::Searchable<T>) {
+      if (!std::is_constant_evaluated())
+        return simd::equal(data_, other.data_, size_);
+    }
+    return std::equal(begin(), end(), other.begin());
+  }
+};
+
+// Views every vector serialized back to back in `bytes` in place, e.g. a
+// whole table file written with serialize()
+template <typename T,
+          size_t N = calculate_static_size(sizeof(SmallVectorRef<T>))>
+SmallVector<SmallVectorRef<T>, N>
+index_wire_vectors(std::span<const std::byte> bytes) {
+  SmallVector<SmallVectorRef<T>, N> refs;
+  while (!bytes.empty()) {
+    refs.push_back(SmallVectorRef<T>::read_wire(bytes));
+  }
+  return refs;
+}
+
+#ifdef SMALLVECTOR_HAS_MMAP
+// A whole file mmap()ed read-only, for pointing SmallVectorRefs into. The
+// pages are only read in as they're touched, so opening a big table is cheap
+class MappedFile {
+private:
+  const std::byte *data_ = nullptr;
+  size_t size_ = 0;
+
+  // Throws for the errno set by `what`, closing `fd` first if it's open
+  [[noreturn]] static void fail(const char *what, int fd = -1) {
+    const int error = errno;
+    if (fd >= 0)
+      ::close(fd);
+    throw std::system_error(error, std::generic_category(), what);
+  }
+
+public:
+  explicit MappedFile(const char *path) {
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      fail("open");
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+      fail("fstat", fd);
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ != 0) {
+      void *ptr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED)
+        fail("mmap", fd);
+      data_ = static_cast<const std::byte *>(ptr);
+    }
+    // The mapping keeps the file alive on its own
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr)
+      ::munmap(const_cast<std::byte *>(data_), size_);
+  }
+
+  std::span<const std::byte> bytes() const noexcept { return {data_, size_}; }
+};
+#endif
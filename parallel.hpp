@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#ifdef SMALLVECTOR_USE_STD_EXECUTION
+#include <execution>
+#endif
+
+#include "vec.hpp"
+
+// for_each / transform / sort / reduce over a SmallVector (of any static size,
+// as they take a SmallVectorImpl) which go parallel
+// once it's big enough for that to pay off, and are just the sequential std
+// algorithms below that. So the same code handles the usual handful of values
+// and the odd huge outlier, and the small case costs one compare.
+//
+// By default the work is spread over std::threads started for the call. They
+// take blocks of values off a shared counter until there are none left, so a
+// slow block doesn't hold up the others. Define SMALLVECTOR_USE_STD_EXECUTION
+// to hand it to std::execution::par_unseq instead (with libstdc++ that needs
+// TBB, so link with -ltbb). Note that then, as the standard says, an exception
+// from `fn` calls std::terminate() rather than being passed on
+namespace parallel {
+
+// Below this many values everything runs inline on the calling thread, as
+// starting threads costs tens of microseconds. Every function takes its own
+// threshold too, to tune it per call site
+inline constexpr size_t DEFAULT_THRESHOLD = size_t(1) << 16;
+
+// The most threads the parallel path uses, counting the calling one. 0 means
+// one per hardware thread. Not used with SMALLVECTOR_USE_STD_EXECUTION
+inline std::atomic<size_t> max_threads{0};
+
+namespace detail {
+// The fewest values worth handing to a thread as one block
+inline constexpr size_t MIN_GRAIN = 4096;
+// Blocks per thread, so there's some slack to balance out uneven blocks
+inline constexpr size_t BLOCKS_PER_WORKER = 8;
+
+inline size_t thread_count() noexcept {
+  const size_t wanted = max_threads.load(std::memory_order_relaxed);
+  return wanted != 0
+             ? wanted
+             : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+inline size_t grain_for(size_t count) noexcept {
+  return std::max(MIN_GRAIN, count / (thread_count() * BLOCKS_PER_WORKER));
+}
+
+// Calls `fn(worker)` for each worker in [0, workers), each on its own thread
+// (worker 0 on the calling one). If they can't all be started, `abandon()` is
+// called to stop the ones that were, before passing the exception on. The
+// first exception from `fn` is rethrown once every thread has finished
+template <typename Fn, typename Abandon>
+void run_workers(size_t workers, Fn fn, Abandon abandon) {
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  const auto work = [&](size_t worker) {
+    try {
+      fn(worker);
+    } catch (...) {
+      const std::lock_guard lock(error_mutex);
+      if (!error)
+        error = std::current_exception();
+    }
+  };
+
+  SmallVector<std::thread> threads;
+  try {
+    threads.reserve(workers - 1);
+    for (size_t i = 1; i < workers; ++i) {
+      threads.emplace_back(work, i);
+    }
+  } catch (...) {
+    abandon(workers - threads.size());
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    throw;
+  }
+  work(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Calls `fn(block, first, last)` for each block of `grain` indices in
+// [0, count), across up to thread_count() threads (the calling one
+// included). If a call throws, the blocks nobody has started yet are skipped,
+// and the first exception is rethrown once every thread has finished
+template <typename Fn> void run_blocks(size_t count, size_t grain, Fn fn) {
+  if (count == 0)
+    return;
+  const size_t blocks = (count + grain - 1) / grain;
+  std::atomic<size_t> next{0};
+  const auto stop = [&] { next.store(blocks, std::memory_order_relaxed); };
+  run_workers(
+      std::min(blocks, thread_count()),
+      [&](size_t) {
+        try {
+          for (size_t block = next.fetch_add(1, std::memory_order_relaxed);
+               block < blocks;
+               block = next.fetch_add(1, std::memory_order_relaxed)) {
+            const size_t first = block * grain;
+            fn(block, first, std::min(first + grain, count));
+          }
+        } catch (...) {
+          stop();
+          throw;
+        }
+      },
+      [&](size_t) { stop(); });
+}
+} // namespace detail
+
+// Calls `fn` on every value of `v`
+template <typename T, typename... Rest, typename Fn>
+void for_each(SmallVectorImpl<T, Rest...> &v, Fn fn,
+              size_t threshold = DEFAULT_THRESHOLD) {
+  if (v.size() < threshold) [[likely]] {
+    std::for_each(v.begin(), v.end(), fn);
+    return;
+  }
+#ifdef SMALLVECTOR_USE_STD_EXECUTION
+  std::for_each(std::execution::par_unseq, v.begin(), v.end(), fn);
+#else
+  T *values = v.data();
+  detail::run_blocks(v.size(), detail::grain_for(v.size()),
+                     [values, &fn](size_t, size_t first, size_t last) {
+                       std::for_each(values + first, values + last, fn);
+                     });
+#endif
+}
+
+// Writes `fn(value)` for every value of `v` to `out`, which must have room
+// for v.size() values (and may be v.begin() itself). Returns the end of what
+// was written
+template <typename T, typename... Rest, std::random_access_iterator Out,
+          typename Fn>
+Out transform(const SmallVectorImpl<T, Rest...> &v, Out out, Fn fn,
+              size_t threshold = DEFAULT_THRESHOLD) {
+  if (v.size() < threshold) [[likely]]
+    return std::transform(v.begin(), v.end(), out, fn);
+#ifdef SMALLVECTOR_USE_STD_EXECUTION
+  return std::transform(std::execution::par_unseq, v.begin(), v.end(), out,
+                        fn);
+#else
+  const T *values = v.data();
+  detail::run_blocks(v.size(), detail::grain_for(v.size()),
+                     [values, out, &fn](size_t, size_t first, size_t last) {
+                       std::transform(values + first, values + last,
+                                      out + first, fn);
+                     });
+  return out + static_cast<std::iter_difference_t<Out>>(v.size());
+#endif
+}
+
+// Sorts `v` by `comp`. Like std::sort, it isn't stable
+template <typename T, typename... Rest, typename Compare = std::less<>>
+void sort(SmallVectorImpl<T, Rest...> &v, Compare comp = {},
+          size_t threshold = DEFAULT_THRESHOLD) {
+  if (v.size() < threshold) [[likely]] {
+    std::sort(v.begin(), v.end(), comp);
+    return;
+  }
+#ifdef SMALLVECTOR_USE_STD_EXECUTION
+  std::sort(std::execution::par_unseq, v.begin(), v.end(), comp);
+#else
+  // Each worker sorts one run, then neighbouring runs are merged a round at a
+  // time until there's just the one. The same threads do every round,
+  // meeting at a barrier in between. Each round has half as many merges as
+  // the one before, so the last is a single std::inplace_merge on one thread
+  T *values = v.data();
+  const size_t count = v.size();
+  const size_t workers = std::max<size_t>(
+      1, std::min(detail::thread_count(),
+                  (count + detail::MIN_GRAIN - 1) / detail::MIN_GRAIN));
+  const size_t run = (count + workers - 1) / workers;
+  std::barrier sync(static_cast<ptrdiff_t>(workers));
+  // Once a worker throws (or can't be started) the rest stop at the next
+  // barrier. Dropping out of it means nobody is left waiting for them
+  std::atomic<bool> failed{false};
+  detail::run_workers(
+      workers,
+      [&](size_t worker) {
+        try {
+          const size_t first = std::min(worker * run, count);
+          std::sort(values + first, values + std::min(first + run, count),
+                    comp);
+          for (size_t width = run; width < count; width *= 2) {
+            sync.arrive_and_wait();
+            if (failed.load()) {
+              sync.arrive_and_drop();
+              return;
+            }
+            const size_t pairs = (count + 2 * width - 1) / (2 * width);
+            for (size_t pair = worker; pair < pairs; pair += workers) {
+              const size_t start = pair * 2 * width;
+              const size_t middle = std::min(start + width, count);
+              const size_t last = std::min(start + 2 * width, count);
+              std::inplace_merge(values + start, values + middle,
+                                 values + last, comp);
+            }
+          }
+        } catch (...) {
+          failed.store(true);
+          sync.arrive_and_drop();
+          throw;
+        }
+      },
+      [&](size_t missing) {
+        failed.store(true);
+        for (size_t i = 0; i < missing; ++i) {
+          sync.arrive_and_drop();
+        }
+      });
+#endif
+}
+
+// Folds every value of `v` into `init` with `op`. Like std::reduce, `op` has
+// to be associative and commutative, as the values are grouped in any order
+template <typename T, typename... Rest, typename R, typename Op = std::plus<>>
+R reduce(const SmallVectorImpl<T, Rest...> &v, R init, Op op = {},
+         size_t threshold = DEFAULT_THRESHOLD) {
+  if (v.size() < threshold) [[likely]]
+    return std::reduce(v.begin(), v.end(), std::move(init), op);
+#ifdef SMALLVECTOR_USE_STD_EXECUTION
+  return std::reduce(std::execution::par_unseq, v.begin(), v.end(),
+                     std::move(init), op);
+#else
+  // Each block folds into its own partial, and then the partials into init
+  const T *values = v.data();
+  const size_t grain = detail::grain_for(v.size());
+  SmallVector<std::optional<R>> partials((v.size() + grain - 1) / grain);
+  detail::run_blocks(v.size(), grain,
+                     [values, &partials, &op](size_t block, size_t first,
+                                              size_t last) {
+                       R partial = values[first];
+                       for (size_t i = first + 1; i < last; ++i) {
+                         partial = op(std::move(partial), values[i]);
+                       }
+                       partials[block] = std::move(partial);
+                     });
+  for (std::optional<R> &partial : partials) {
+    init = op(std::move(init), std::move(*partial));
+  }
+  return init;
+#endif
+}
+} // namespace parallel
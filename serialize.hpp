@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#define SMALLVECTOR_HAS_IOVEC 1
+#endif
+
+#include "vec.hpp"
+
+// A compact binary format for SmallVectors of trivially copyable values: an
+// 8 byte little endian count, followed by the values' bytes exactly as they
+// are in memory. So both ends need the same sizeof(T), layout and byte order
+// for T itself. Writing is zero-copy (the payload is our own storage), and
+// reading goes straight into the SmallVector's storage, which is the static
+// storage if the count fits in STATIC_AMOUNT, else a single exact allocation.
+// Everything takes a SmallVectorImpl, so one instantiation serves every
+// STATIC_AMOUNT
+
+constexpr size_t WIRE_PREFIX_BYTES = 8;
+
+// The length prefix for a payload of `count` values
+using WirePrefix = std::array<std::byte, WIRE_PREFIX_BYTES>;
+
+constexpr WirePrefix make_wire_prefix(uint64_t count) noexcept {
+  WirePrefix prefix{};
+  for (size_t i = 0; i < WIRE_PREFIX_BYTES; ++i) {
+    prefix[i] = static_cast<std::byte>(count >> (8 * i));
+  }
+  return prefix;
+}
+
+constexpr uint64_t read_wire_prefix(std::span<const std::byte> bytes) {
+  if (bytes.size() < WIRE_PREFIX_BYTES)
+    throw std::out_of_range("Truncated SmallVector length prefix");
+  uint64_t count = 0;
+  for (size_t i = 0; i < WIRE_PREFIX_BYTES; ++i) {
+    count |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+  }
+  return count;
+}
+
+// How many bytes serialize() writes for `v`
+template <typename T, typename... Rest>
+  requires std::is_trivially_copyable_v<T>
+constexpr size_t
+serialized_size(const SmallVectorImpl<T, Rest...> &v) noexcept {
+  return WIRE_PREFIX_BYTES + v.size() * sizeof(T);
+}
+
+// Writes `v` to the front of `out`, returning how many bytes were written
+template <typename T, typename... Rest>
+  requires std::is_trivially_copyable_v<T>
+size_t serialize(const SmallVectorImpl<T, Rest...> &v,
+                 std::span<std::byte> out) {
+  const size_t bytes = serialized_size(v);
+  if (out.size() < bytes)
+    throw std::length_error("Buffer too small for SmallVector");
+  const WirePrefix prefix = make_wire_prefix(v.size());
+  std::memcpy(out.data(), prefix.data(), WIRE_PREFIX_BYTES);
+  if (!v.empty())
+    std::memcpy(out.data() + WIRE_PREFIX_BYTES, v.data(),
+                bytes - WIRE_PREFIX_BYTES);
+  return bytes;
+}
+
+// Replaces the values in `v` with the ones serialized at the front of `in`,
+// and returns how many bytes were read
+template <typename T, typename... Rest>
+  requires std::is_trivially_copyable_v<T>
+size_t deserialize(std::span<const std::byte> in,
+                   SmallVectorImpl<T, Rest...> &v) {
+  const uint64_t count = read_wire_prefix(in);
+  if (count > v.max_size() ||
+      count > (in.size() - WIRE_PREFIX_BYTES) / sizeof(T))
+    throw std::out_of_range("Truncated SmallVector payload");
+  v.clear();
+  v.resize_for_overwrite(static_cast<size_t>(count));
+  if (count != 0)
+    std::memcpy(v.data(), in.data() + WIRE_PREFIX_BYTES,
+                v.size() * sizeof(T));
+  return WIRE_PREFIX_BYTES + v.size() * sizeof(T);
+}
+
+#ifdef SMALLVECTOR_HAS_IOVEC
+// Points `iov` at the bytes of `v`'s values, for writev() / sendmsg(). Only
+// valid until `v` next grows
+template <typename T, typename... Rest>
+  requires std::is_trivially_copyable_v<T>
+void write_to(iovec &iov, const SmallVectorImpl<T, Rest...> &v) noexcept {
+  const std::span<const std::byte> bytes = v.as_bytes();
+  iov.iov_base = const_cast<std::byte *>(bytes.data());
+  iov.iov_len = bytes.size();
+}
+
+// Points `iov` at `prefix` and then the values of `v`, for writing `v` in the
+// wire format with a single writev(). `prefix` must outlive the write
+template <typename T, typename... Rest>
+  requires std::is_trivially_copyable_v<T>
+void write_to(std::span<iovec, 2> iov, WirePrefix &prefix,
+              const SmallVectorImpl<T, Rest...> &v) noexcept {
+  prefix = make_wire_prefix(v.size());
+  iov[0].iov_base = prefix.data();
+  iov[0].iov_len = WIRE_PREFIX_BYTES;
+  write_to(iov[1], v);
+}
+
+// Resizes `v` to `count` (uninitialised) values and points `iov` at them, so
+// readv() / recvmsg() can fill them in place once the prefix has been read
+template <typename T, typename... Rest>
+  requires std::is_trivially_copyable_v<T>
+void read_into(iovec &iov, SmallVectorImpl<T, Rest...> &v, size_t count) {
+  v.clear();
+  v.resize_for_overwrite(count);
+  const std::span<std::byte> bytes = v.as_writable_bytes();
+  iov.iov_base = bytes.data();
+  iov.iov_len = bytes.size();
+}
+#endif
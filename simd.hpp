@@ -0,0 +1,314 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(SMALLVECTOR_NO_SIMD)
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Explicitly vectorised search / compare kernels for arithmetic types, used by
+// SmallVector's find(), contains(), count() and operator==, and a streaming
+// copy for appending huge runs of trivially copyable values. The instruction
+// set is picked at compile time: AVX2 if enabled (e.g. -mavx2 or
+// -march=native), else SSE2 (always there on x86-64), else NEON on AArch64,
+// else a scalar loop. Define SMALLVECTOR_NO_SIMD to always use the scalar
+// loop. The loads are unaligned, as the static storage is only aligned to T
+namespace simd {
+
+// The types the kernels handle. Equality is ==, so for floating point types
+// NaN is never equal to anything and -0.0 == 0.0, same as std::find
+template <typename T>
+concept Searchable =
+    (std::is_integral_v<T> && !std::is_same_v<T, bool>) ||
+    std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+#if defined(SMALLVECTOR_NO_SIMD)
+#elif defined(__AVX2__)
+#define SMALLVECTOR_SIMD 1
+using Vec = __m256i;
+constexpr size_t VEC_BYTES = 32;
+// How many bits of mask() each byte of a comparison gives
+constexpr size_t MASK_BITS_PER_BYTE = 1;
+
+inline Vec load(const void *ptr) {
+  return _mm256_loadu_si256(static_cast<const __m256i *>(ptr));
+}
+
+// Non-temporal store, `ptr` must be aligned to VEC_BYTES
+#define SMALLVECTOR_SIMD_STREAM 1
+inline void stream(void *ptr, Vec v) {
+  _mm256_stream_si256(static_cast<__m256i *>(ptr), v);
+}
+
+template <typename T> inline Vec splat(T value) {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm256_castps_si256(_mm256_set1_ps(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm256_castpd_si256(_mm256_set1_pd(value));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm256_set1_epi8(static_cast<char>(value));
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm256_set1_epi16(static_cast<short>(value));
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm256_set1_epi32(static_cast<int>(value));
+  } else {
+    return _mm256_set1_epi64x(static_cast<long long>(value));
+  }
+}
+
+// All ones in each lane where a == b
+template <typename T> inline Vec lanes_equal(Vec a, Vec b) {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm256_castps_si256(_mm256_cmp_ps(
+        _mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _CMP_EQ_OQ));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm256_castpd_si256(_mm256_cmp_pd(
+        _mm256_castsi256_pd(a), _mm256_castsi256_pd(b), _CMP_EQ_OQ));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm256_cmpeq_epi8(a, b);
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm256_cmpeq_epi16(a, b);
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm256_cmpeq_epi32(a, b);
+  } else {
+    return _mm256_cmpeq_epi64(a, b);
+  }
+}
+
+inline uint64_t mask(Vec v) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+}
+
+#elif defined(__SSE2__)
+#define SMALLVECTOR_SIMD 1
+using Vec = __m128i;
+constexpr size_t VEC_BYTES = 16;
+constexpr size_t MASK_BITS_PER_BYTE = 1;
+
+inline Vec load(const void *ptr) {
+  return _mm_loadu_si128(static_cast<const __m128i *>(ptr));
+}
+
+#define SMALLVECTOR_SIMD_STREAM 1
+inline void stream(void *ptr, Vec v) {
+  _mm_stream_si128(static_cast<__m128i *>(ptr), v);
+}
+
+template <typename T> inline Vec splat(T value) {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm_castps_si128(_mm_set1_ps(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm_castpd_si128(_mm_set1_pd(value));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm_set1_epi8(static_cast<char>(value));
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm_set1_epi16(static_cast<short>(value));
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm_set1_epi32(static_cast<int>(value));
+  } else {
+    return _mm_set1_epi64x(static_cast<long long>(value));
+  }
+}
+
+template <typename T> inline Vec lanes_equal(Vec a, Vec b) {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm_castps_si128(
+        _mm_cmpeq_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm_castpd_si128(
+        _mm_cmpeq_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b)));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm_cmpeq_epi8(a, b);
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm_cmpeq_epi16(a, b);
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm_cmpeq_epi32(a, b);
+  } else {
+    // SSE2 has no 64 bit compare, so both 32 bit halves have to match
+    const __m128i halves = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(halves,
+                         _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+  }
+}
+
+inline uint64_t mask(Vec v) {
+  return static_cast<uint32_t>(_mm_movemask_epi8(v));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SMALLVECTOR_SIMD 1
+using Vec = uint8x16_t;
+constexpr size_t VEC_BYTES = 16;
+// NEON has no movemask, so we narrow each byte down to a nibble instead
+constexpr size_t MASK_BITS_PER_BYTE = 4;
+
+inline Vec load(const void *ptr) {
+  return vld1q_u8(static_cast<const uint8_t *>(ptr));
+}
+
+template <typename T> inline Vec splat(T value) {
+  if constexpr (std::is_same_v<T, float>) {
+    return vreinterpretq_u8_f32(vdupq_n_f32(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return vreinterpretq_u8_f64(vdupq_n_f64(value));
+  } else if constexpr (sizeof(T) == 1) {
+    return vdupq_n_u8(static_cast<uint8_t>(value));
+  } else if constexpr (sizeof(T) == 2) {
+    return vreinterpretq_u8_u16(vdupq_n_u16(static_cast<uint16_t>(value)));
+  } else if constexpr (sizeof(T) == 4) {
+    return vreinterpretq_u8_u32(vdupq_n_u32(static_cast<uint32_t>(value)));
+  } else {
+    return vreinterpretq_u8_u64(vdupq_n_u64(static_cast<uint64_t>(value)));
+  }
+}
+
+template <typename T> inline Vec lanes_equal(Vec a, Vec b) {
+  if constexpr (std::is_same_v<T, float>) {
+    return vreinterpretq_u8_u32(
+        vceqq_f32(vreinterpretq_f32_u8(a), vreinterpretq_f32_u8(b)));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return vreinterpretq_u8_u64(
+        vceqq_f64(vreinterpretq_f64_u8(a), vreinterpretq_f64_u8(b)));
+  } else if constexpr (sizeof(T) == 1) {
+    return vceqq_u8(a, b);
+  } else if constexpr (sizeof(T) == 2) {
+    return vreinterpretq_u8_u16(
+        vceqq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+  } else if constexpr (sizeof(T) == 4) {
+    return vreinterpretq_u8_u32(
+        vceqq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)));
+  } else {
+    return vreinterpretq_u8_u64(
+        vceqq_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b)));
+  }
+}
+
+inline uint64_t mask(Vec v) {
+  const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+#endif
+
+#ifdef SMALLVECTOR_SIMD
+// How many values of T fit in one register
+template <typename T> constexpr size_t LANES = VEC_BYTES / sizeof(T);
+// How many bits of mask() each value of T gives
+template <typename T>
+constexpr size_t MASK_BITS = sizeof(T) * MASK_BITS_PER_BYTE;
+// mask() when every lane compared equal
+constexpr uint64_t FULL_MASK =
+    (VEC_BYTES * MASK_BITS_PER_BYTE == 64)
+        ? ~uint64_t{0}
+        : (uint64_t{1} << (VEC_BYTES * MASK_BITS_PER_BYTE)) - 1;
+#endif
+
+// Returns the index of the first of the `n` values at `data` equal to
+// `value`, or `n` if there isn't one
+template <Searchable T> size_t find(const T *data, size_t n, T value) {
+  size_t i = 0;
+#ifdef SMALLVECTOR_SIMD
+  const Vec needle = splat(value);
+  for (; i + LANES<T> <= n; i += LANES<T>) {
+    const uint64_t found = mask(lanes_equal<T>(load(data + i), needle));
+    if (found != 0)
+      return i + static_cast<size_t>(std::countr_zero(found)) / MASK_BITS<T>;
+  }
+#endif
+  for (; i < n; ++i) {
+    if (data[i] == value)
+      return i;
+  }
+  return n;
+}
+
+// Returns how many of the `n` values at `data` are equal to `value`
+template <Searchable T> size_t count(const T *data, size_t n, T value) {
+  size_t i = 0;
+  size_t total = 0;
+#ifdef SMALLVECTOR_SIMD
+  const Vec needle = splat(value);
+  for (; i + LANES<T> <= n; i += LANES<T>) {
+    const uint64_t found = mask(lanes_equal<T>(load(data + i), needle));
+    total += static_cast<size_t>(std::popcount(found)) / MASK_BITS<T>;
+  }
+#endif
+  for (; i < n; ++i) {
+    total += (data[i] == value) ? 1 : 0;
+  }
+  return total;
+}
+
+// Returns true if the `n` values at `a` are equal to the `n` values at `b`
+template <Searchable T> bool equal(const T *a, const T *b, size_t n) {
+  size_t i = 0;
+#ifdef SMALLVECTOR_SIMD
+  for (; i + LANES<T> <= n; i += LANES<T>) {
+    if (mask(lanes_equal<T>(load(a + i), load(b + i))) != FULL_MASK)
+      return false;
+  }
+#endif
+  for (; i < n; ++i) {
+    if (!(a[i] == b[i]))
+      return false;
+  }
+  return true;
+}
+
+// Copies of at least this many bytes are taken to be well past the size of
+// the L2 cache (1 - 2 MB on current x86 cores), so go through stream_copy()
+constexpr size_t STREAM_COPY_BYTES = size_t(1) << 21;
+
+// stream_copy() writes a cache line at a time, and prefetches the source this
+// far ahead of what it's reading
+constexpr size_t STREAM_LINE_BYTES = 64;
+constexpr size_t STREAM_PREFETCH_BYTES = 8 * STREAM_LINE_BYTES;
+
+// Copies `bytes` bytes from `src` to `dst`, which mustn't overlap, like
+// memcpy(). Where we have them (x86), the stores are non-temporal, so they go
+// out to memory without pulling the lines into the cache, and the source is
+// prefetched non-temporally too. So a copy much bigger than the cache doesn't
+// evict everyone else's working set on the way through. The copy itself
+// isn't left in the cache either, so it's not worth it for smaller ones
+inline void stream_copy(void *dst, const void *src, size_t bytes) {
+#ifdef SMALLVECTOR_SIMD_STREAM
+  auto *out = static_cast<unsigned char *>(dst);
+  const auto *in = static_cast<const unsigned char *>(src);
+  // The streaming stores have to be aligned, so copy up to the first line
+  // boundary of `dst` as usual
+  const size_t misalignment =
+      reinterpret_cast<uintptr_t>(out) % STREAM_LINE_BYTES;
+  size_t head = misalignment == 0 ? 0 : STREAM_LINE_BYTES - misalignment;
+  head = head < bytes ? head : bytes;
+  std::memcpy(out, in, head);
+  out += head;
+  in += head;
+  bytes -= head;
+
+  for (; bytes >= STREAM_LINE_BYTES; bytes -= STREAM_LINE_BYTES) {
+    // Prefetching past the end of `src` is harmless, it never faults
+    _mm_prefetch(reinterpret_cast<const char *>(in + STREAM_PREFETCH_BYTES),
+                 _MM_HINT_NTA);
+    for (size_t i = 0; i < STREAM_LINE_BYTES; i += VEC_BYTES) {
+      stream(out + i, load(in + i));
+    }
+    out += STREAM_LINE_BYTES;
+    in += STREAM_LINE_BYTES;
+  }
+  // Streaming stores aren't ordered with the ones after them, so make sure
+  // they're all visible before anyone is told the copy is done
+  _mm_sfence();
+  std::memcpy(out, in, bytes);
+#else
+  if (bytes != 0)
+    std::memcpy(dst, src, bytes);
+#endif
+}
+
+} // namespace simd
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "vec.hpp"
+
+// A string which keeps up to STATIC_AMOUNT chars inline, so short keys, paths
+// and log fields never allocate. By default it's sized so the whole thing
+// fills a cache line. Underneath it's a SmallVector<char> which always ends
+// in a '\0', so c_str() never has to allocate or copy.
+//
+// It has push_back() and value_type, so std::back_inserter() works on it, for
+// std::format_to() and the like to write straight into it
+template <size_t STATIC_AMOUNT = calculate_static_size(sizeof(char)) - 1>
+class SmallString {
+private:
+  // Our chars, followed by a '\0'
+  SmallVector<char, STATIC_AMOUNT + 1> chars_;
+
+  // Whether `str` views (some of) our own chars, which growing would free.
+  // Comparing pointers into different objects isn't allowed in constant
+  // evaluation, so there we can't tell, and assume not
+  constexpr bool is_own(std::string_view str) const noexcept {
+    if (std::is_constant_evaluated())
+      return false;
+    const std::less_equal<const char *> less_equal;
+    return less_equal(data(), str.data()) &&
+           less_equal(str.data(), data() + size());
+  }
+
+public:
+  using value_type = char;
+  using traits_type = std::char_traits<char>;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using reference = char &;
+  using const_reference = const char &;
+  using iterator = char *;
+  using const_iterator = const char *;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  constexpr SmallString() { chars_.push_back('\0'); }
+  constexpr SmallString(std::string_view str) : SmallString() { append(str); }
+  constexpr SmallString(const char *str)
+      : SmallString(std::string_view(str)) {}
+  constexpr SmallString(size_t count, char ch) : SmallString() {
+    append(count, ch);
+  }
+
+  constexpr SmallString(const SmallString &) = default;
+  constexpr SmallString &operator=(const SmallString &) = default;
+
+  // The moved from string is left empty, still with its '\0'. It always has
+  // room for that, so we only throw if moving chars_ can
+  constexpr SmallString(SmallString &&other) noexcept(
+      std::is_nothrow_move_constructible_v<decltype(chars_)>)
+      : chars_(std::move(other.chars_)) {
+    other.chars_.push_back('\0');
+  }
+  constexpr SmallString &operator=(SmallString &&other) noexcept(
+      std::is_nothrow_move_assignable_v<decltype(chars_)>) {
+    if (this != &other) {
+      chars_ = std::move(other.chars_);
+      other.chars_.push_back('\0');
+    }
+    return *this;
+  }
+
+  constexpr SmallString &operator=(std::string_view str) {
+    if (is_own(str))
+      return *this = SmallString(str);
+    clear();
+    return append(str);
+  }
+  constexpr SmallString &operator=(const char *str) {
+    return *this = std::string_view(str);
+  }
+
+  // ----- ELEMENT ACCESS -----
+  constexpr char &operator[](size_t idx) noexcept { return chars_[idx]; }
+  constexpr const char &operator[](size_t idx) const noexcept {
+    return chars_[idx];
+  }
+
+  constexpr char &at(size_t idx) {
+    if (idx >= size())
+      throw std::out_of_range("Out of range access");
+    return chars_[idx];
+  }
+  constexpr const char &at(size_t idx) const {
+    if (idx >= size())
+      throw std::out_of_range("Out of range access");
+    return chars_[idx];
+  }
+
+  constexpr char &front() noexcept { return chars_[0]; }
+  constexpr const char &front() const noexcept { return chars_[0]; }
+  constexpr char &back() noexcept { return chars_[size() - 1]; }
+  constexpr const char &back() const noexcept { return chars_[size() - 1]; }
+
+  constexpr char *data() noexcept { return chars_.data(); }
+  constexpr const char *data() const noexcept { return chars_.data(); }
+  // Always null terminated, and valid until we are next changed
+  constexpr const char *c_str() const noexcept { return chars_.data(); }
+
+  // ----- ITERATORS -----
+  constexpr iterator begin() noexcept { return data(); }
+  constexpr const_iterator begin() const noexcept { return data(); }
+  constexpr iterator end() noexcept { return data() + size(); }
+  constexpr const_iterator end() const noexcept { return data() + size(); }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+  constexpr reverse_iterator rbegin() noexcept {
+    return reverse_iterator(end());
+  }
+  constexpr const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator(end());
+  }
+  constexpr reverse_iterator rend() noexcept {
+    return reverse_iterator(begin());
+  }
+  constexpr const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator(begin());
+  }
+
+  // ----- CAPACITY -----
+  constexpr bool empty() const noexcept { return size() == 0; }
+  constexpr size_t size() const noexcept { return chars_.size() - 1; }
+  constexpr size_t length() const noexcept { return size(); }
+  constexpr size_t capacity() const noexcept { return chars_.capacity() - 1; }
+  static constexpr size_t max_size() noexcept {
+    return decltype(chars_)::max_size() - 1;
+  }
+  static constexpr size_t get_static_size() noexcept { return STATIC_AMOUNT; }
+
+  // Makes room for `size` chars (plus the '\0')
+  constexpr void reserve(size_t size) {
+    if (size > max_size())
+      throw std::length_error("Requested reserve above maximum size");
+    chars_.reserve(size + 1);
+  }
+  constexpr void shrink_to_fit() { chars_.shrink_to_fit(); }
+
+  constexpr bool is_array() const noexcept { return chars_.is_array(); }
+  constexpr bool is_vector() const noexcept { return chars_.is_vector(); }
+
+  // ----- MODIFIERS -----
+  constexpr void clear() noexcept {
+    chars_.resize(1);
+    chars_[0] = '\0';
+  }
+
+  // Pushes the new '\0' first, so if growing throws we still have the old one
+  constexpr void push_back(char ch) {
+    chars_.push_back('\0');
+    chars_[size() - 1] = ch;
+  }
+
+  // Removes the last char, if empty this is UB
+  constexpr void pop_back() noexcept {
+    chars_.pop_back();
+    chars_.back() = '\0';
+  }
+
+  // Appends `str`, which may be a view of our own chars
+  constexpr SmallString &append(std::string_view str) {
+    if (str.size() > capacity() - size() && is_own(str)) {
+      const SmallString copy(str);
+      return append(copy.view());
+    }
+    // Slotting them in before the '\0' only has to shuffle it up, and grows
+    // by the growth policy rather than to exactly fit
+    chars_.insert(chars_.end() - 1, str.begin(), str.end());
+    return *this;
+  }
+
+  constexpr SmallString &append(size_t count, char ch) {
+    chars_.insert(chars_.end() - 1, count, ch);
+    return *this;
+  }
+
+  template <std::input_iterator It>
+  constexpr SmallString &append(It first, It last) {
+    chars_.insert(chars_.end() - 1, first, last);
+    return *this;
+  }
+
+  constexpr SmallString &operator+=(std::string_view str) {
+    return append(str);
+  }
+  constexpr SmallString &operator+=(char ch) {
+    push_back(ch);
+    return *this;
+  }
+
+  // Shrinks down to, or grows up to, `count` chars, new ones being `ch`
+  constexpr void resize(size_t count, char ch = '\0') {
+    if (count < size()) {
+      chars_.resize(count + 1);
+      chars_[count] = '\0';
+    } else {
+      append(count - size(), ch);
+    }
+  }
+
+  // ----- CONVERSIONS -----
+  constexpr std::string_view view() const noexcept { return {data(), size()}; }
+  constexpr operator std::string_view() const noexcept { return view(); }
+  std::string str() const { return std::string(view()); }
+};
+
+template <size_t N, size_t M>
+constexpr bool operator==(const SmallString<N> &lhs,
+                          const SmallString<M> &rhs) noexcept {
+  return lhs.view() == rhs.view();
+}
+template <size_t N>
+constexpr bool operator==(const SmallString<N> &lhs,
+                          std::string_view rhs) noexcept {
+  return lhs.view() == rhs;
+}
+
+template <size_t N, size_t M>
+constexpr std::strong_ordering operator<=>(const SmallString<N> &lhs,
+                                           const SmallString<M> &rhs) noexcept {
+  return lhs.view() <=> rhs.view();
+}
+template <size_t N>
+constexpr std::strong_ordering operator<=>(const SmallString<N> &lhs,
+                                           std::string_view rhs) noexcept {
+  return lhs.view() <=> rhs;
+}
+
+// Hashes the same as the std::string_view of the chars, so SmallStrings can
+// be looked up by std::string_view in a transparent hash map
+template <size_t N> struct std::hash<SmallString<N>> {
+  size_t operator()(const SmallString<N> &str) const noexcept {
+    return std::hash<std::string_view>()(str.view());
+  }
+};
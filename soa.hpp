@@ -0,0 +1,529 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "vec.hpp"
+
+// Where each column of a SmallSoAVector<Ts...> lives in a block with room
+// for `capacity` rows. The columns are back to back in the order given, each
+// padded out to its own alignment
+template <typename... Ts> struct SoALayout {
+  static constexpr size_t COLUMNS = sizeof...(Ts);
+  static constexpr std::array<size_t, COLUMNS> SIZES = {sizeof(Ts)...};
+  static constexpr std::array<size_t, COLUMNS> ALIGNS = {alignof(Ts)...};
+  static constexpr size_t ALIGNMENT = std::max({alignof(Ts)...});
+  // The bytes one row takes up across all the columns
+  static constexpr size_t ROW_BYTES = (sizeof(Ts) + ...);
+
+  static constexpr size_t align_up(size_t bytes, size_t alignment) noexcept {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+  // The byte offset of column `column` (or the end of the block, for
+  // column == COLUMNS)
+  static constexpr size_t offset(size_t column, size_t capacity) noexcept {
+    size_t bytes = 0;
+    for (size_t i = 0; i < column; ++i) {
+      bytes = align_up(bytes, ALIGNS[i]) + capacity * SIZES[i];
+    }
+    return column < COLUMNS ? align_up(bytes, ALIGNS[column]) : bytes;
+  }
+
+  static constexpr size_t bytes(size_t capacity) noexcept {
+    return offset(COLUMNS, capacity);
+  }
+};
+
+// calculate_static_size() for a SmallSoAVector: as many rows as fit in the
+// budget alongside the header, counting the padding between the columns,
+// with the same fallbacks for rows that don't fit at all
+template <typename... Ts>
+consteval size_t
+calculate_soa_static_size(const size_t header_bytes = header_size_bytes(),
+                          const size_t budget_bytes = CACHE_LINE_SIZE_BYTES) {
+  using Layout = SoALayout<Ts...>;
+  size_t amount =
+      calculate_static_size(Layout::ROW_BYTES, header_bytes, budget_bytes);
+  if (Layout::ROW_BYTES <= budget_bytes) {
+    while (amount > 1 && header_bytes + Layout::bytes(amount) > budget_bytes) {
+      --amount;
+    }
+  }
+  return amount;
+}
+
+// A vector of rows (Ts...) stored as a structure of arrays: each column is
+// its own contiguous array, so a loop over one field only pulls that field
+// into the cache, and can be vectorised. Like SmallVector, the first
+// STATIC_AMOUNT rows live inline, and all the columns spill over together
+// into one heap block after that
+template <size_t STATIC_AMOUNT, typename... Ts> class SmallSoAVectorN {
+private:
+  static_assert(sizeof...(Ts) > 0, "Need at least one column");
+  static_assert(STATIC_AMOUNT > 0, "STATIC_AMOUNT must be at least 1");
+
+  using Layout = SoALayout<Ts...>;
+  using Indices = std::index_sequence_for<Ts...>;
+
+  template <size_t I> using Column = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+  template <typename T>
+  static constexpr bool nothrow_relocate_v =
+      is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>;
+  // Whether every column can be moved to a new block without throwing
+  static constexpr bool NOTHROW_RELOCATE = (nothrow_relocate_v<Ts> && ...);
+
+  // data_ points at arr_ while we are using the static storage, and at a heap
+  // block once we have spilled over
+  std::byte *data_;
+  size_t size_;
+  size_t capacity_;
+
+  alignas(Layout::ALIGNMENT) std::byte arr_[Layout::bytes(STATIC_AMOUNT)];
+
+  // The start of column I in `block`, which has room for `capacity` rows
+  template <size_t I>
+  static constexpr Column<I> *column_in(std::byte *block, size_t capacity) {
+    return reinterpret_cast<Column<I> *>(block + Layout::offset(I, capacity));
+  }
+
+  template <size_t I> constexpr Column<I> *column_ptr() const {
+    return column_in<I>(data_, capacity_);
+  }
+
+  // Calls `fn.template operator()<I>()` for every column index I
+  template <typename Fn> static constexpr void for_each_column(Fn &&fn) {
+    [&]<size_t... Is>(std::index_sequence<Is...>) {
+      (fn.template operator()<Is>(), ...);
+    }(Indices{});
+  }
+
+  // Moves `count` values from `src` into the uninitialised `dst`, destructing
+  // the values left behind
+  template <typename T>
+  static constexpr void relocate(T *src, size_t count, T *dst) {
+    if constexpr (is_trivially_relocatable_v<T>) {
+      if (count != 0)
+        std::memcpy(static_cast<void *>(dst), static_cast<const void *>(src),
+                    count * sizeof(T));
+    } else {
+      for (size_t i = 0; i < count; ++i) {
+        std::construct_at(dst + i, std::move(src[i]));
+        std::destroy_at(src + i);
+      }
+    }
+  }
+
+  // Where to take column I's values from when moving them to a new block can
+  // throw. They're copied if they can be, else moved, but either way the
+  // originals are only destructed once every column has made it
+  template <size_t I> constexpr auto transfer_from() const noexcept {
+    if constexpr (std::is_copy_constructible_v<Column<I>>) {
+      return column_ptr<I>();
+    } else {
+      return std::make_move_iterator(column_ptr<I>());
+    }
+  }
+
+  // Constructs rows [first, first + count) of every column in `block`, which
+  // has room for `capacity` rows, with `build.template operator()<I>(dst)`.
+  // The build for a column tidies up after itself if it throws (as the
+  // std::uninitialized_* algorithms do), and then the columns before it are
+  // destroyed again, so no rows are left half built
+  template <typename Build>
+  static constexpr void build_columns(std::byte *block, size_t capacity,
+                                      size_t first, size_t count,
+                                      Build &&build) {
+    size_t built = 0;
+    try {
+      for_each_column([&]<size_t I>() {
+        build.template operator()<I>(column_in<I>(block, capacity) + first);
+        ++built;
+      });
+    } catch (...) {
+      for_each_column([&]<size_t I>() {
+        if (I < built)
+          std::destroy_n(column_in<I>(block, capacity) + first, count);
+      });
+      throw;
+    }
+  }
+
+  constexpr bool is_vector_block() const noexcept { return data_ != arr_; }
+
+  // Moves every column into a new heap block with room for `capacity` rows.
+  // If a column's move can throw, they're all copied over instead, and if
+  // one throws the block is given back and we still have all of our rows
+  constexpr void spillover(size_t capacity) {
+    auto *block = static_cast<std::byte *>(::operator new(
+        Layout::bytes(capacity), std::align_val_t(Layout::ALIGNMENT)));
+    if constexpr (NOTHROW_RELOCATE) {
+      for_each_column([&]<size_t I>() {
+        relocate(column_ptr<I>(), size_, column_in<I>(block, capacity));
+      });
+    } else {
+      try {
+        build_columns(block, capacity, 0, size_, [&]<size_t I>(auto *dst) {
+          std::uninitialized_copy_n(transfer_from<I>(), size_, dst);
+        });
+      } catch (...) {
+        ::operator delete(block, std::align_val_t(Layout::ALIGNMENT));
+        throw;
+      }
+      for_each_column(
+          [&]<size_t I>() { std::destroy_n(column_ptr<I>(), size_); });
+    }
+    free_heap();
+    data_ = block;
+    capacity_ = capacity;
+  }
+
+  constexpr void grow(size_t min_capacity) {
+    if (min_capacity > max_size())
+      throw std::length_error("SmallSoAVector grown above maximum size");
+    spillover(std::min(
+        GrowBy2::next_capacity(capacity_, min_capacity, Layout::ROW_BYTES),
+        max_size()));
+  }
+
+  constexpr void free_heap() noexcept {
+    if (is_vector_block())
+      ::operator delete(data_, std::align_val_t(Layout::ALIGNMENT));
+  }
+
+  constexpr void reset_to_array() noexcept {
+    data_ = arr_;
+    capacity_ = STATIC_AMOUNT;
+  }
+
+  // Takes the rows from `other`, which is left empty. We must be empty and in
+  // array mode beforehand
+  constexpr void take_from(SmallSoAVectorN &&other) {
+    if (other.is_vector()) {
+      data_ = other.data_;
+      capacity_ = other.capacity_;
+      other.reset_to_array();
+    } else {
+      for_each_column([&]<size_t I>() {
+        relocate(other.column_ptr<I>(), other.size_, column_ptr<I>());
+      });
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
+  // We must be empty beforehand, and stay that way if a copy throws
+  constexpr void copy_from(const SmallSoAVectorN &other) {
+    reserve(other.size_);
+    build_columns(data_, capacity_, 0, other.size_, [&]<size_t I>(auto *dst) {
+      std::uninitialized_copy_n(other.column_ptr<I>(), other.size_, dst);
+    });
+    size_ = other.size_;
+  }
+
+  // Zipped iteration over all the columns at once. Dereferencing gives a
+  // std::tuple of references, so `for (auto [x, y] : soa)` binds x and y to
+  // the values in the row
+  template <bool CONST> class Iterator {
+  private:
+    friend class SmallSoAVectorN;
+    template <bool> friend class Iterator;
+    template <typename T> using Ptr = std::conditional_t<CONST, const T, T> *;
+
+    std::tuple<Ptr<Ts>...> ptrs_;
+
+    constexpr explicit Iterator(std::tuple<Ptr<Ts>...> ptrs) : ptrs_(ptrs) {}
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::tuple<Ts...>;
+    using difference_type = ptrdiff_t;
+    using reference = std::tuple<std::remove_pointer_t<Ptr<Ts>> &...>;
+
+    constexpr Iterator() = default;
+    // Lets an iterator be turned into a const_iterator
+    template <bool OTHER_CONST>
+      requires(CONST && !OTHER_CONST)
+    constexpr Iterator(const Iterator<OTHER_CONST> &other)
+        : ptrs_(other.ptrs_) {}
+
+    constexpr reference operator*() const {
+      return std::apply([](auto *...ptrs) { return reference(*ptrs...); },
+                        ptrs_);
+    }
+    constexpr reference operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    constexpr Iterator &operator+=(difference_type n) {
+      std::apply([n](auto *&...ptrs) { ((ptrs += n), ...); }, ptrs_);
+      return *this;
+    }
+    constexpr Iterator &operator-=(difference_type n) { return *this += -n; }
+    constexpr Iterator &operator++() { return *this += 1; }
+    constexpr Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+    constexpr Iterator &operator--() { return *this += -1; }
+    constexpr Iterator operator--(int) {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+    constexpr Iterator operator+(difference_type n) const {
+      Iterator it = *this;
+      return it += n;
+    }
+    friend constexpr Iterator operator+(difference_type n, Iterator it) {
+      return it += n;
+    }
+    constexpr Iterator operator-(difference_type n) const {
+      Iterator it = *this;
+      return it += -n;
+    }
+    constexpr difference_type operator-(const Iterator &other) const {
+      return std::get<0>(ptrs_) - std::get<0>(other.ptrs_);
+    }
+
+    constexpr bool operator==(const Iterator &other) const {
+      return std::get<0>(ptrs_) == std::get<0>(other.ptrs_);
+    }
+    constexpr auto operator<=>(const Iterator &other) const {
+      return std::get<0>(ptrs_) <=> std::get<0>(other.ptrs_);
+    }
+  };
+
+  template <size_t... Is>
+  constexpr Iterator<false> iterator_at(size_t idx,
+                                        std::index_sequence<Is...>) const {
+    return Iterator<false>(std::tuple(column_ptr<Is>() + idx...));
+  }
+
+public:
+  using value_type = std::tuple<Ts...>;
+  using reference = std::tuple<Ts &...>;
+  using const_reference = std::tuple<const Ts &...>;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  constexpr SmallSoAVectorN() noexcept
+      : data_(arr_), size_(0), capacity_(STATIC_AMOUNT) {}
+
+  // `count` value-initialised rows
+  constexpr explicit SmallSoAVectorN(size_t count) : SmallSoAVectorN() {
+    resize(count);
+  }
+
+  constexpr SmallSoAVectorN(const SmallSoAVectorN &other) : SmallSoAVectorN() {
+    copy_from(other);
+  }
+
+  // Only relocates the rows if other is in array mode, so as long as that
+  // can't throw neither can this
+  constexpr SmallSoAVectorN(SmallSoAVectorN &&other) noexcept(NOTHROW_RELOCATE)
+      : SmallSoAVectorN() {
+    take_from(std::move(other));
+  }
+
+  constexpr SmallSoAVectorN &operator=(const SmallSoAVectorN &other) {
+    if (this != &other) {
+      clear();
+      copy_from(other);
+    }
+    return *this;
+  }
+
+  constexpr SmallSoAVectorN &
+  operator=(SmallSoAVectorN &&other) noexcept(NOTHROW_RELOCATE) {
+    if (this != &other) {
+      clear();
+      free_heap();
+      reset_to_array();
+      take_from(std::move(other));
+    }
+    return *this;
+  }
+
+  constexpr ~SmallSoAVectorN() {
+    clear();
+    free_heap();
+  }
+
+  // ----- ELEMENT ACCESS -----
+  // The row at `idx`, as a tuple of references into each column
+  constexpr reference operator[](size_t idx) { return *(begin() + idx); }
+  constexpr const_reference operator[](size_t idx) const {
+    return *(begin() + idx);
+  }
+
+  constexpr reference at(size_t idx) {
+    if (idx >= size_)
+      throw std::out_of_range("Out of range access");
+    return (*this)[idx];
+  }
+  constexpr const_reference at(size_t idx) const {
+    if (idx >= size_)
+      throw std::out_of_range("Out of range access");
+    return (*this)[idx];
+  }
+
+  constexpr reference front() { return (*this)[0]; }
+  constexpr const_reference front() const { return (*this)[0]; }
+  constexpr reference back() { return (*this)[size_ - 1]; }
+  constexpr const_reference back() const { return (*this)[size_ - 1]; }
+
+  // Column I on its own, which is what the hot loops should go through
+  template <size_t I> constexpr std::span<Column<I>> column() noexcept {
+    return {column_ptr<I>(), size_};
+  }
+  template <size_t I>
+  constexpr std::span<const Column<I>> column() const noexcept {
+    return {column_ptr<I>(), size_};
+  }
+
+  // ----- ITERATORS -----
+  constexpr iterator begin() noexcept { return iterator_at(0, Indices{}); }
+  constexpr const_iterator begin() const noexcept {
+    return iterator_at(0, Indices{});
+  }
+  constexpr iterator end() noexcept { return iterator_at(size_, Indices{}); }
+  constexpr const_iterator end() const noexcept {
+    return iterator_at(size_, Indices{});
+  }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+
+  // ----- CAPACITY -----
+  constexpr bool empty() const noexcept { return size_ == 0; }
+  constexpr size_t size() const noexcept { return size_; }
+  constexpr size_t capacity() const noexcept { return capacity_; }
+
+  static constexpr size_t max_size() noexcept {
+    return std::numeric_limits<size_t>::max() / Layout::ROW_BYTES;
+  }
+
+  // Makes room for `size` rows in total, without growing any further
+  constexpr void reserve(size_t size) {
+    if (size > max_size())
+      throw std::length_error("Requested reserve above maximum size");
+    if (size > capacity_)
+      spillover(size);
+  }
+
+  // ----- MODIFIERS -----
+  constexpr void clear() noexcept {
+    for_each_column([&]<size_t I>() {
+      std::destroy_n(column_ptr<I>(), size_);
+    });
+    size_ = 0;
+  }
+
+  // Adds a row with each column's value made from the matching argument
+  template <typename... Args>
+    requires(sizeof...(Args) == sizeof...(Ts))
+  constexpr reference emplace_back(Args &&...args) {
+    if (size_ == capacity_) {
+      // One of `args` may be one of our own values, so build the row before
+      // moving everything into the new heap block
+      std::tuple<Ts...> row(std::forward<Args>(args)...);
+      grow(size_ + 1);
+      std::apply(
+          [this](auto &&...values) { construct_back(std::move(values)...); },
+          row);
+    } else {
+      construct_back(std::forward<Args>(args)...);
+    }
+    return back();
+  }
+
+  constexpr void push_back(const Ts &...values) { emplace_back(values...); }
+
+  constexpr void pop_back() {
+    --size_;
+    for_each_column(
+        [&]<size_t I>() { std::destroy_at(column_ptr<I>() + size_); });
+  }
+
+  // Removes the row at `idx`, shuffling the ones after it down
+  constexpr void erase(size_t idx) {
+    for_each_column([&]<size_t I>() {
+      Column<I> *column = column_ptr<I>();
+      std::move(column + idx + 1, column + size_, column + idx);
+    });
+    pop_back();
+  }
+
+  // Shrinks down to, or grows up to, `count` rows. New rows are
+  // value-initialised, and if one throws we keep the size we had
+  constexpr void resize(size_t count) {
+    if (count < size_) {
+      for_each_column([&]<size_t I>() {
+        std::destroy(column_ptr<I>() + count, column_ptr<I>() + size_);
+      });
+    } else if (count > size_) {
+      reserve(count);
+      build_columns(data_, capacity_, size_, count - size_,
+                    [&]<size_t I>(auto *dst) {
+                      std::uninitialized_value_construct_n(dst, count - size_);
+                    });
+    }
+    size_ = count;
+  }
+
+  constexpr void swap(SmallSoAVectorN &other) noexcept(NOTHROW_RELOCATE) {
+    SmallSoAVectorN tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  // ----- HELPFUL FUNCTIONS -----
+  // Returns true if the rows live in a heap block
+  constexpr bool is_vector() const noexcept { return is_vector_block(); }
+  constexpr bool is_array() const noexcept { return !is_vector_block(); }
+
+  static constexpr size_t get_static_size() noexcept { return STATIC_AMOUNT; }
+
+private:
+  // Constructs the values of a new last row. There must be room for it. If a
+  // column's constructor throws, the columns already built are destroyed
+  // again, so there's no half built row
+  template <typename... Args> constexpr void construct_back(Args &&...args) {
+    size_t built = 0;
+    try {
+      [&]<size_t... Is>(std::index_sequence<Is...>) {
+        ((std::construct_at(column_ptr<Is>() + size_,
+                            std::forward<Args>(args)),
+          ++built),
+         ...);
+      }(Indices{});
+    } catch (...) {
+      for_each_column([&]<size_t I>() {
+        if (I < built)
+          std::destroy_at(column_ptr<I>() + size_);
+      });
+      throw;
+    }
+    ++size_;
+  }
+};
+
+// A SmallSoAVectorN with its STATIC_AMOUNT picked so it fits in a cache line
+template <typename... Ts>
+using SmallSoAVector =
+    SmallSoAVectorN<calculate_soa_static_size<Ts...>(), Ts...>;
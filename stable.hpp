@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "vec.hpp"
+
+// A SmallVector whose values never move once they've been added, so pointers
+// and references to them stay valid however much it grows. The first
+// STATIC_AMOUNT values are inline like a SmallVector's, and after that each
+// heap chunk is as big as everything before it. So there are only ever a
+// handful of chunks, and finding the one holding a value is a single
+// bit_width() of its index rather than a lookup through a side table.
+//
+// The price is that the values aren't contiguous, so there's no data(). Use
+// for_each_chunk() to go through them a chunk at a time. Moving the whole
+// SmallStableVector still moves the inline values, but not the rest
+template <typename T, size_t STATIC_AMOUNT = calculate_static_size(sizeof(T))>
+class SmallStableVector {
+private:
+  static_assert(STATIC_AMOUNT > 0, "STATIC_AMOUNT must be at least 1");
+
+  using AllocTraits = std::allocator_traits<std::allocator<T>>;
+
+  // chunks_[k - 1] is chunk k, which holds STATIC_AMOUNT << (k - 1) values.
+  // Chunk 0 is arr_. Growing chunks_ itself only moves the pointers
+  SmallVector<T *, 4> chunks_;
+  size_t size_ = 0;
+
+  union Storage {
+    constexpr Storage() noexcept {}
+    constexpr ~Storage() {}
+    T values[STATIC_AMOUNT];
+  };
+  Storage arr_;
+
+  static constexpr size_t chunk_capacity(size_t chunk) noexcept {
+    return chunk == 0 ? STATIC_AMOUNT : STATIC_AMOUNT << (chunk - 1);
+  }
+
+  // The index of the first value in `chunk`
+  static constexpr size_t chunk_start(size_t chunk) noexcept {
+    return chunk == 0 ? 0 : STATIC_AMOUNT << (chunk - 1);
+  }
+
+  static constexpr size_t chunk_of(size_t idx) noexcept {
+    return static_cast<size_t>(std::bit_width(idx / STATIC_AMOUNT));
+  }
+
+  constexpr T *chunk_ptr(size_t chunk) const noexcept {
+    return chunk == 0 ? const_cast<T *>(arr_.values) : chunks_[chunk - 1];
+  }
+
+  // Where the value at `idx` lives. Its chunk must already exist
+  constexpr T *slot(size_t idx) const noexcept {
+    const size_t chunk = chunk_of(idx);
+    return chunk_ptr(chunk) + (idx - chunk_start(chunk));
+  }
+
+  // Allocates the next chunk, doubling our capacity
+  constexpr void add_chunk() {
+    if (chunks_.size() + 1 >= std::numeric_limits<size_t>::digits ||
+        capacity() > max_size() / 2)
+      throw std::length_error("SmallStableVector grown above maximum size");
+    const size_t capacity = chunk_capacity(chunks_.size() + 1);
+    std::allocator<T> alloc;
+    T *block = AllocTraits::allocate(alloc, capacity);
+    try {
+      chunks_.push_back(block);
+    } catch (...) {
+      AllocTraits::deallocate(alloc, block, capacity);
+      throw;
+    }
+  }
+
+  // Calls `fn(values, count)` for each chunk holding any of the first `size`
+  // values, in order
+  template <typename Fn>
+  constexpr void for_each_block(size_t size, Fn fn) const {
+    for (size_t chunk = 0; chunk_start(chunk) < size; ++chunk) {
+      fn(chunk_ptr(chunk),
+         std::min(chunk_capacity(chunk), size - chunk_start(chunk)));
+    }
+  }
+
+  // Destructs the values from `count` onwards
+  constexpr void destroy_from(size_t count) noexcept {
+    for (size_t chunk = chunk_of(count); chunk_start(chunk) < size_;
+         ++chunk) {
+      const size_t first = chunk_start(chunk);
+      const size_t start = std::max(count, first);
+      const size_t stop = std::min(size_, first + chunk_capacity(chunk));
+      std::destroy(chunk_ptr(chunk) + (start - first),
+                   chunk_ptr(chunk) + (stop - first));
+    }
+    size_ = count;
+  }
+
+  // Frees the heap chunks from `chunk` onwards, which must be empty
+  constexpr void free_chunks(size_t chunk) noexcept {
+    std::allocator<T> alloc;
+    for (size_t k = chunks_.size(); k >= chunk && k > 0; --k) {
+      AllocTraits::deallocate(alloc, chunks_[k - 1], chunk_capacity(k));
+      chunks_.pop_back();
+    }
+  }
+
+  constexpr void copy_from(const SmallStableVector &other) {
+    reserve(other.size_);
+    other.for_each_block(other.size_, [this](const T *values, size_t count) {
+      for (size_t i = 0; i < count; ++i) {
+        emplace_back(values[i]);
+      }
+    });
+  }
+
+  // Takes the values from `other`, which is left empty. We must be empty and
+  // have no heap chunks beforehand
+  constexpr void take_from(SmallStableVector &&other) {
+    const size_t inline_count = std::min(other.size_, STATIC_AMOUNT);
+    for (size_t i = 0; i < inline_count; ++i) {
+      std::construct_at(arr_.values + i, std::move(other.arr_.values[i]));
+    }
+    std::destroy_n(other.arr_.values, inline_count);
+    chunks_ = std::move(other.chunks_);
+    other.chunks_.clear();
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
+  template <bool CONST> class Iterator {
+  private:
+    friend class SmallStableVector;
+    template <bool> friend class Iterator;
+    using Parent =
+        std::conditional_t<CONST, const SmallStableVector, SmallStableVector>;
+
+    Parent *parent_ = nullptr;
+    size_t idx_ = 0;
+
+    constexpr Iterator(Parent *parent, size_t idx)
+        : parent_(parent), idx_(idx) {}
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = std::conditional_t<CONST, const T, T> *;
+    using reference = std::conditional_t<CONST, const T, T> &;
+
+    constexpr Iterator() = default;
+    // Lets an iterator be turned into a const_iterator
+    template <bool OTHER_CONST>
+      requires(CONST && !OTHER_CONST)
+    constexpr Iterator(const Iterator<OTHER_CONST> &other)
+        : parent_(other.parent_), idx_(other.idx_) {}
+
+    constexpr reference operator*() const { return *parent_->slot(idx_); }
+    constexpr pointer operator->() const { return parent_->slot(idx_); }
+    constexpr reference operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    constexpr Iterator &operator+=(difference_type n) {
+      idx_ += static_cast<size_t>(n);
+      return *this;
+    }
+    constexpr Iterator &operator-=(difference_type n) { return *this += -n; }
+    constexpr Iterator &operator++() { return *this += 1; }
+    constexpr Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+    constexpr Iterator &operator--() { return *this += -1; }
+    constexpr Iterator operator--(int) {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+    constexpr Iterator operator+(difference_type n) const {
+      Iterator it = *this;
+      return it += n;
+    }
+    friend constexpr Iterator operator+(difference_type n, Iterator it) {
+      return it += n;
+    }
+    constexpr Iterator operator-(difference_type n) const {
+      Iterator it = *this;
+      return it += -n;
+    }
+    constexpr difference_type operator-(const Iterator &other) const {
+      return static_cast<difference_type>(idx_ - other.idx_);
+    }
+
+    constexpr bool operator==(const Iterator &other) const {
+      return idx_ == other.idx_;
+    }
+    constexpr auto operator<=>(const Iterator &other) const {
+      return idx_ <=> other.idx_;
+    }
+  };
+
+public:
+  using value_type = T;
+  using reference = T &;
+  using const_reference = const T &;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  // Iterators are indices under the hood, so like references they stay valid
+  // as we grow
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  constexpr SmallStableVector() noexcept = default;
+
+  // `count` value-initialised values
+  constexpr explicit SmallStableVector(size_t count) { resize(count); }
+
+  constexpr SmallStableVector(std::initializer_list<T> init) {
+    reserve(init.size());
+    for (const T &value : init) {
+      emplace_back(value);
+    }
+  }
+
+  constexpr SmallStableVector(const SmallStableVector &other) {
+    copy_from(other);
+  }
+
+  constexpr SmallStableVector(SmallStableVector &&other) {
+    take_from(std::move(other));
+  }
+
+  constexpr SmallStableVector &operator=(const SmallStableVector &other) {
+    if (this != &other) {
+      clear();
+      copy_from(other);
+    }
+    return *this;
+  }
+
+  constexpr SmallStableVector &operator=(SmallStableVector &&other) {
+    if (this != &other) {
+      clear();
+      free_chunks(1);
+      take_from(std::move(other));
+    }
+    return *this;
+  }
+
+  constexpr ~SmallStableVector() {
+    clear();
+    free_chunks(1);
+  }
+
+  // ----- ELEMENT ACCESS -----
+  constexpr T &operator[](size_t idx) noexcept { return *slot(idx); }
+  constexpr const T &operator[](size_t idx) const noexcept {
+    return *slot(idx);
+  }
+
+  constexpr T &at(size_t idx) {
+    if (idx >= size_)
+      throw std::out_of_range("Out of range access");
+    return *slot(idx);
+  }
+  constexpr const T &at(size_t idx) const {
+    if (idx >= size_)
+      throw std::out_of_range("Out of range access");
+    return *slot(idx);
+  }
+
+  constexpr T &front() noexcept { return arr_.values[0]; }
+  constexpr const T &front() const noexcept { return arr_.values[0]; }
+  constexpr T &back() noexcept { return *slot(size_ - 1); }
+  constexpr const T &back() const noexcept { return *slot(size_ - 1); }
+
+  // ----- ITERATORS -----
+  constexpr iterator begin() noexcept { return iterator(this, 0); }
+  constexpr const_iterator begin() const noexcept {
+    return const_iterator(this, 0);
+  }
+  constexpr iterator end() noexcept { return iterator(this, size_); }
+  constexpr const_iterator end() const noexcept {
+    return const_iterator(this, size_);
+  }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+  constexpr reverse_iterator rbegin() noexcept {
+    return reverse_iterator(end());
+  }
+  constexpr const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator(end());
+  }
+  constexpr reverse_iterator rend() noexcept {
+    return reverse_iterator(begin());
+  }
+  constexpr const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator(begin());
+  }
+
+  // ----- CAPACITY -----
+  constexpr bool empty() const noexcept { return size_ == 0; }
+  constexpr size_t size() const noexcept { return size_; }
+  constexpr size_t capacity() const noexcept {
+    return chunk_start(chunks_.size() + 1);
+  }
+  constexpr size_t max_size() const noexcept {
+    return std::numeric_limits<size_t>::max() / sizeof(T);
+  }
+  static constexpr size_t get_static_size() noexcept { return STATIC_AMOUNT; }
+
+  // Allocates chunks until there's room for `new_capacity` values
+  constexpr void reserve(size_t new_capacity) {
+    if (new_capacity > max_size())
+      throw std::length_error("Requested reserve above maximum size");
+    while (capacity() < new_capacity) {
+      add_chunk();
+    }
+  }
+
+  // Frees the heap chunks which hold no values
+  constexpr void shrink_to_fit() noexcept {
+    free_chunks(size_ == 0 ? 1 : chunk_of(size_ - 1) + 1);
+  }
+
+  // ----- MODIFIERS -----
+  // Constructs a new value at the back. Nothing already in here moves, so
+  // `args` may refer to our own values
+  template <typename... Args> constexpr T &emplace_back(Args &&...args) {
+    if (size_ == capacity())
+      add_chunk();
+    T *value = std::construct_at(slot(size_), std::forward<Args>(args)...);
+    ++size_;
+    return *value;
+  }
+
+  constexpr void push_back(const T &value) { emplace_back(value); }
+  constexpr void push_back(T &&value) { emplace_back(std::move(value)); }
+
+  // Removes the last value, if empty this is UB
+  constexpr void pop_back() noexcept { std::destroy_at(slot(--size_)); }
+
+  // Shrinks down to, or grows up to, `count` values. New values are
+  // value-initialised
+  constexpr void resize(size_t count) {
+    if (count < size_) {
+      destroy_from(count);
+      return;
+    }
+    reserve(count);
+    while (size_ < count) {
+      emplace_back();
+    }
+  }
+
+  // Destructs every value, keeping the heap chunks for reuse
+  constexpr void clear() noexcept { destroy_from(0); }
+
+  // Calls `fn(std::span<T>)` for each chunk's values in order, for going
+  // through them all without working out each one's chunk
+  template <typename Fn> constexpr void for_each_chunk(Fn fn) {
+    for_each_block(size_, [&fn](T *values, size_t count) {
+      fn(std::span<T>(values, count));
+    });
+  }
+  template <typename Fn> constexpr void for_each_chunk(Fn fn) const {
+    for_each_block(size_, [&fn](const T *values, size_t count) {
+      fn(std::span<const T>(values, count));
+    });
+  }
+};
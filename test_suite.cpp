@@ -1,6 +1,32 @@
+#include "arena.hpp"
+#include "buffer_cache.hpp"
+#include "concurrent.hpp"
+#include "flat.hpp"
+#include "instrumentation.hpp"
+#include "mapped.hpp"
+#include "parallel.hpp"
+#include "serialize.hpp"
+#include "small_string.hpp"
+#include "soa.hpp"
+#include "stable.hpp"
 #include "ut.hpp" // Boost's UT!
 #include "vec.hpp"
 
+#include <charconv>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#if defined(SMALLVECTOR_HAS_IOVEC) || defined(SMALLVECTOR_HAS_MMAP)
+#include <unistd.h>
+#endif
+
 struct Simple {
   int a;
   int b;
@@ -33,6 +59,150 @@ struct Tracker {
   }
 };
 
+// Throws from its copy constructor (and its move constructor too, unless
+// NOTHROW_MOVE) once `budget` of them have run, for exception safety testing
+template <bool NOTHROW_MOVE> struct Fragile {
+  static inline int budget = std::numeric_limits<int>::max();
+  static inline int copy_count = 0;
+  static inline int move_count = 0;
+
+  int value;
+
+  Fragile(int v) : value(v) {
+    if (v < 0)
+      throw std::invalid_argument("Negative Fragile");
+  }
+  Fragile(const Fragile &other) : value(other.value) {
+    spend();
+    ++copy_count;
+  }
+  Fragile(Fragile &&other) noexcept(NOTHROW_MOVE) : value(other.value) {
+    if constexpr (!NOTHROW_MOVE)
+      spend();
+    ++move_count;
+  }
+  Fragile &operator=(const Fragile &) = default;
+  Fragile &operator=(Fragile &&) = default;
+
+  bool operator==(const Fragile &) const = default;
+
+  static void spend() {
+    if (budget-- <= 0)
+      throw std::runtime_error("Out of budget");
+  }
+
+  static void reset(int new_budget = std::numeric_limits<int>::max()) {
+    budget = new_budget;
+    copy_count = move_count = 0;
+  }
+};
+
+// Move only, and its move throws once `budget` of them have run
+struct FragileMoveOnly {
+  static inline int budget = std::numeric_limits<int>::max();
+
+  std::unique_ptr<int> value;
+
+  FragileMoveOnly(int v) : value(std::make_unique<int>(v)) {}
+  FragileMoveOnly(FragileMoveOnly &&other) {
+    if (budget-- <= 0)
+      throw std::runtime_error("Out of budget");
+    value = std::move(other.value);
+  }
+  FragileMoveOnly &operator=(FragileMoveOnly &&) = default;
+};
+
+// A unique_ptr like handle, which is safe to memcpy to a new address
+struct Handle {
+  std::unique_ptr<int> ptr;
+
+  Handle(int val) : ptr(std::make_unique<int>(val)) {}
+};
+
+template <> struct is_trivially_relocatable<Handle> : std::true_type {};
+
+// Names the sites used by the instrumentation tests
+struct TestSite {
+  static constexpr std::string_view name = "test.site";
+};
+
+// Built at compile time, to check SmallVector works in constant evaluation
+constexpr int sum_of_squares(int n) {
+  SmallVector<int, 4> v;
+  for (int i = 0; i < n; ++i) {
+    v.push_back(i * i);
+  }
+  int sum = 0;
+  for (int x : v) {
+    sum += x;
+  }
+  return sum;
+}
+
+constexpr bool edit_strings() {
+  SmallVector<std::string, 2> v = {"b", "d"};
+  v.insert(v.begin() + 1, "c"); // Spills over
+  v.insert(v.begin(), std::string(40, 'a'));
+  v.erase(v.begin());
+  v.emplace(v.begin(), "a");
+  SmallVector<std::string, 2> copy = v;
+  copy.pop_back();
+  SmallVector<std::string, 2> moved = std::move(copy);
+  moved.swap(v);
+  v.resize(5, "e");
+  moved.resize(2);
+  return v.size() == 5 && v[2] == "c" && v.count("e") == 2 &&
+         v.find("b") == v.begin() + 1 && !v.contains("d") &&
+         moved.shrink_to_inline() && moved[1] == "b";
+}
+
+constexpr SmallVector<int, 16> make_squares() {
+  SmallVector<int, 16> squares;
+  for (int i = 0; i < 16; ++i) {
+    squares.push_back(i * i);
+  }
+  squares.erase(squares.begin()); // Exercise a shuffle down too
+  return squares;
+}
+
+// Compiled just the once, however much the caller keeps inline
+static size_t fill_with_counts(SmallVectorImpl<int> &v, int count) {
+  for (int i = 0; i < count; ++i) {
+    v.push_back(i);
+  }
+  v.erase(v.begin());
+  return v.size();
+}
+
+// Spilling over through a SmallVectorImpl & works in constant evaluation too
+constexpr bool append_across_sizes() {
+  SmallVector<int, 2> small = {1, 2};
+  SmallVector<int, 8> big = {3, 4, 5};
+  SmallVectorImpl<int> &impl = small;
+  impl.append(big);
+  impl.append(std::move(big));
+  return small.is_vector() && small.size() == 8 && small.back() == 5 &&
+         big.empty() && small != big;
+}
+
+// So std::vector and friends move SmallVectors when they grow, not copy them
+static_assert(std::is_nothrow_move_constructible_v<SmallVector<std::string>>);
+static_assert(std::is_nothrow_move_assignable_v<SmallVector<std::string>>);
+static_assert(std::is_nothrow_swappable_v<SmallVector<std::string>>);
+static_assert(std::is_nothrow_move_constructible_v<SmallString<>>);
+static_assert(std::is_nothrow_move_assignable_v<SmallString<>>);
+// Moving between pmr resources may have to allocate
+static_assert(!std::is_nothrow_move_assignable_v<pmr::SmallVector<int>>);
+
+static_assert(sum_of_squares(3) == 5);
+static_assert(append_across_sizes());
+static_assert(sum_of_squares(10) == 285);
+static_assert(edit_strings());
+
+// Fits in the static storage, so it's a real constant in .rodata
+constexpr auto SQUARES = make_squares();
+static_assert(make_squares().size() == 15 && make_squares().back() == 225);
+
 int Tracker::constructor_count = 0;
 int Tracker::destructor_count = 0;
 int Tracker::move_count = 0;
@@ -109,20 +279,114 @@ int main() {
     };
   };
 
+  "[lookup]"_test = [] {
+    // Every size up to a few registers wide, so the needle lands in both the
+    // vector loop and the scalar tail
+    auto check_type = []<typename T>(T) {
+      for (size_t size = 0; size <= 70; ++size) {
+        SmallVector<T> v;
+        for (size_t i = 0; i < size; ++i) {
+          v.push_back(static_cast<T>(i % 100 + 1));
+        }
+        for (size_t i = 0; i < size; ++i) {
+          expect(v.find(v[i]) - v.begin() ==
+                 std::find(v.begin(), v.end(), v[i]) - v.begin());
+        }
+        expect(v.find(T{0}) == v.end());
+        expect(!v.contains(T{0}));
+        expect(v.contains(T{1}) == (size != 0));
+        expect(v.count(T{1}) == static_cast<size_t>(std::count(
+                                    v.begin(), v.end(), T{1})));
+
+        SmallVector<T> copy;
+        copy.append_range(v);
+        expect(copy == v);
+        if (size != 0) {
+          copy[size - 1] = T{0};
+          expect(copy != v);
+          copy[size - 1] = v[size - 1];
+          copy[0] = T{0};
+          expect(copy != v);
+        }
+      }
+    };
+
+    should("find()/contains()/count()/operator== for arithmetic types") =
+        [check_type] {
+          check_type(int8_t{});
+          check_type(uint8_t{});
+          check_type(int16_t{});
+          check_type(int{});
+          check_type(uint32_t{});
+          check_type(int64_t{});
+          check_type(uint64_t{});
+          check_type(float{});
+          check_type(double{});
+        };
+
+    should("64 bit values differing in one half") = [] {
+      SmallVector<int64_t> v(9, int64_t{1} << 32);
+      expect(v.find(1) == v.end());
+      expect(v.count(int64_t{1} << 32) == 9_u);
+      SmallVector<int64_t> other = v;
+      other[7] = (int64_t{1} << 32) | 1;
+      expect(other != v);
+      expect(other.find((int64_t{1} << 32) | 1) - other.begin() == 7_i);
+    };
+
+    should("NaN is never found or equal") = [] {
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+      SmallVector<double> v(20, 1.0);
+      v[9] = nan;
+      expect(v.find(nan) == v.end());
+      expect(v.count(nan) == 0_u);
+      expect(v != v);
+      v[9] = -0.0;
+      expect(v.find(0.0) - v.begin() == 9_i);
+    };
+
+    should("non arithmetic types") = [] {
+      SmallVector<std::string> v = {"a", "b", "c", "b"};
+      expect(v.find("b") - v.begin() == 1_i);
+      expect(v.find("z") == v.end());
+      expect(v.contains("c"));
+      expect(v.count("b") == 2_u);
+    };
+  };
+
   "[capacity]"_test = [] {
     SmallVector<int, 4> v = {1, 2, 3, 4, 5};
 
     should("clear()/size()/empty()") = [v] {
       expect(v.is_vector()) << "Expecting vector mode with STATIC_AMOUNT = 4";
+      const size_t capacity = v.capacity();
       mut(v).clear();
-      expect(v.is_array()) << "Expecting array mode after clear()";
+      expect(v.is_vector()) << "Expecting clear() to keep the heap block";
+      expect(v.capacity() == capacity);
       expect(v.size() == 0_u);
       expect(v.empty());
-      // Should also be in array mode
-      expect(v.is_array());
+    };
+
+    should("release()") = [v] {
+      mut(v).release();
+      expect(v.is_array()) << "Expecting array mode after release()";
+      expect(v.capacity() == 4_u);
+      expect(v.empty());
       expect(!v.is_vector()); // Obvious from the code, but, let's check!
     };
 
+    should("shrink_to_inline()") = [v] {
+      expect(!mut(v).shrink_to_inline()) << "5 values don't fit in 4";
+      expect(v.is_vector());
+      mut(v).pop_back();
+      expect(mut(v).shrink_to_inline());
+      expect(v.is_array());
+      expect(v.size() == 4_u);
+      for (int i = 0; i < 4; ++i) {
+        expect(v[i] == i + 1);
+      }
+    };
+
     should("reserve(count)") = [v] {
       mut(v).resize(10);
       expect(10_u == v.size());
@@ -142,6 +406,92 @@ int main() {
       expect(v2.capacity() == 8_i);
     };
 
+    should("data() in both modes") = [] {
+      SmallVector<int, 4> v2 = {1, 2, 3};
+      expect(v2.data() == &v2[0]);
+      v2.push_back(4);
+      v2.push_back(5); // Spills over
+      expect(fatal(v2.is_vector()));
+      expect(v2.capacity() >= 5_u);
+      expect(v2.data() == &v2[0]);
+      for (int i = 0; i < 5; ++i) {
+        expect(v2[i] == i + 1);
+      }
+    };
+
+    should("calculate_static_size()") = [] {
+      // The whole SmallVector should fit in a cache line
+      expect(sizeof(SmallVector<int>) == CACHE_LINE_SIZE_BYTES);
+      expect(sizeof(SmallVector<char>) == CACHE_LINE_SIZE_BYTES);
+      expect(sizeof(SmallVector<Simple>) == CACHE_LINE_SIZE_BYTES);
+      constexpr size_t header = header_size_bytes(sizeof(uint32_t));
+      using SmallerSize =
+          SmallVector<uint32_t, calculate_static_size(sizeof(uint32_t), header),
+                      uint32_t>;
+      expect(SmallerSize().get_static_size() ==
+             (CACHE_LINE_SIZE_BYTES - header) / sizeof(uint32_t));
+      expect(sizeof(SmallerSize) == CACHE_LINE_SIZE_BYTES);
+      expect(sizeof(pmr::SmallVector<int>) == CACHE_LINE_SIZE_BYTES);
+
+      // Only T fits, and T bigger than the cache line
+      expect(calculate_static_size(60) == 1_u);
+      expect(calculate_static_size(100) == FALLBACK_SIZE);
+      // With a bigger budget
+      expect(calculate_static_size(sizeof(int), header_size_bytes(), 128) ==
+             (128 - header_size_bytes()) / sizeof(int));
+    };
+
+    should("growth policy") = [] {
+      SmallVector<int, 8> v2(9);
+      expect(v2.capacity() == 9_u) << "Constructing reserves exactly";
+      SmallVector<int, 8> v3;
+      for (int i = 0; i < 16; ++i) {
+        v3.push_back(i);
+        if (i == 8) {
+          expect(v3.capacity() == 16_u) << "First spill should double";
+        }
+      }
+      expect(v3.capacity() == 16_u) << "No reallocation until 16";
+
+      SmallVector<int, 8, size_t, std::allocator<int>, GrowBy1_5> v4(8);
+      v4.push_back(8);
+      expect(v4.capacity() == 12_u);
+
+      SmallVector<Simple, 3, size_t, std::allocator<Simple>, GrowToPowerOfTwo>
+          v5(3);
+      v5.emplace_back(1, 2);
+      // 6 * 8 = 48 bytes, rounded up to 64 bytes
+      expect(v5.capacity() == 8_u);
+
+      // Too big to round up, or even to double, without overflowing
+      constexpr size_t HUGE_CAPACITY = SIZE_MAX / 8 - 1;
+      static_assert(GrowToPowerOfTwo::next_capacity(SIZE_MAX / 16 + 1, 0, 8) ==
+                    SIZE_MAX / 8);
+      static_assert(GrowToPowerOfTwo::next_capacity(HUGE_CAPACITY, 0, 8) ==
+                    SIZE_MAX / 8);
+      static_assert(GrowToPowerOfTwo::next_capacity(0, HUGE_CAPACITY, 8) ==
+                    HUGE_CAPACITY);
+      static_assert(GrowToPowerOfTwo::next_capacity(SIZE_MAX / 2, 0, 1) ==
+                    SIZE_MAX - 1);
+    };
+
+    should("SizeT") = [] {
+      SmallVector<uint32_t, 6, uint32_t> v32;
+      if constexpr (SMALLVECTOR_ALIGNMENT != 1) {
+        expect(alignof(decltype(v32)) == CACHE_LINE_SIZE_BYTES);
+      } else if constexpr (SMALLVECTOR_HARDENING < 2) {
+        expect(sizeof(v32) == 40_u) << "8 byte pointer, 8 byte sizes, 6 values";
+      }
+      expect(v32.max_size() == std::numeric_limits<uint32_t>::max());
+
+      SmallVector<uint8_t, 4, uint8_t> v8;
+      expect(v8.max_size() == 255_u);
+      v8.resize(255);
+      expect(v8.size() == 255_u);
+      expect(throws([&] { v8.push_back(1); })) << "Past max_size() throws";
+      expect(throws([&] { v8.reserve(256); }));
+    };
+
     should("shrink_to_fit()") = [v] {
       std::vector<int> v_mock = {1, 2, 3, 4, 5};
       // Let's add elements to v (and real vector v_mock) to make it enter
@@ -157,6 +507,36 @@ int main() {
       expect(v.size() == v_mock.size())
           << "Expect sizes to be same after shrink_to_fit";
     };
+
+    should("shrink_to_fit() back into the static storage") = [] {
+      SmallVector<int, 4> v;
+      for (int i = 0; i < 1000; ++i) {
+        v.push_back(i);
+      }
+      v.resize(10);
+      v.shrink_to_fit();
+      expect(v.is_vector());
+      expect(v.capacity() == 10_u) << "Too big for inline, so fit the block";
+      v.resize(3);
+      v.shrink_to_fit();
+      expect(v.is_array()) << "Should have gone back inline";
+      expect(v.capacity() == 4_u);
+      expect(v == SmallVector({0, 1, 2}));
+
+      SmallVector<std::string, 2> strings = {"a", "b", "c"};
+      strings.pop_back();
+      strings.shrink_to_fit();
+      expect(strings.is_array());
+      expect(strings[0] == "a" && strings[1] == "b");
+
+      Fragile<false>::reset();
+      SmallVector<Fragile<false>, 2> fragile = {1, 2, 3};
+      fragile.pop_back();
+      Fragile<false>::reset(1);
+      expect(throws([&] { fragile.shrink_to_fit(); }));
+      expect(fragile.is_vector()) << "A failed copy should leave it as it was";
+      expect(fragile[0].value == 1_i && fragile[1].value == 2_i);
+    };
   };
 
   "[modifiers]"_test = [] {
@@ -169,6 +549,50 @@ int main() {
       expect(v.size() == 7_i);
     };
 
+    should("insert() ranges") = [] {
+      SmallVector<int, 8> v = {1, 2, 3};
+      const std::vector<int> src = {10, 11, 12};
+      auto it = v.insert(v.begin() + 1, src.begin(), src.end());
+      expect(*it == 10_i);
+      expect(fatal(v.size() == 6_u));
+      expect(v.is_array());
+      it = v.insert(v.end() - 1, 4, 7); // Spills over
+      expect(it == v.begin() + 5);
+      expect(v.is_vector());
+      const std::vector<int> expected = {1, 10, 11, 12, 2, 7, 7, 7, 7, 3};
+      expect(std::equal(v.begin(), v.end(), expected.begin(), expected.end()));
+
+      // Single pass iterators
+      std::istringstream stream("20 21");
+      v.insert(v.begin(), std::istream_iterator<int>(stream),
+               std::istream_iterator<int>());
+      expect(v.size() == 12_u);
+      expect(v[0] == 20_i && v[1] == 21_i && v[2] == 1_i);
+
+      SmallVector<std::string, 2> strs = {"a", "d"};
+      strs.insert(strs.begin() + 1, {"b", "c"});
+      expect(strs.size() == 4_u);
+      expect(strs[1] == "b" && strs[2] == "c" && strs[3] == "d");
+    };
+
+    should("append_range()/assign()") = [] {
+      SmallVector<int, 4> v = {1, 2};
+      const std::list<int> list = {3, 4, 5};
+      v.append_range(list);
+      expect(v.size() == 5_u);
+      expect(v.capacity() >= 5_u);
+      expect(v[4] == 5_i);
+
+      v.assign(list.begin(), list.end());
+      expect(v.size() == 3_u);
+      expect(v[0] == 3_i && v[2] == 5_i);
+      v.assign(6, 9);
+      expect(v.size() == 6_u);
+      expect(std::all_of(v.begin(), v.end(), [](int val) { return val == 9; }));
+      v.assign({1, 2});
+      expect(v.size() == 2_u && v[1] == 2_i);
+    };
+
     should("emplace()/emplace_back()") = [] {
       SmallVector<Simple> v(5);
       v.emplace(v.end(), 1, 2);
@@ -227,6 +651,82 @@ int main() {
       expect(v2 == SmallVector({4, 5, 6, 7}));
     };
 
+    should("pop_back() only destructs the last value") = [] {
+      SmallVector<Tracker, 4> v(6);
+      Tracker::reset();
+      v.pop_back();
+      expect(v.size() == 5_u);
+      expect(Tracker::destructor_count == 1_i);
+      expect(Tracker::move_count == 0_i && Tracker::copy_count == 0_i);
+    };
+
+    should("swap_erase()") = [] {
+      SmallVector<int, 4> v = {1, 2, 3, 4, 5, 6};
+      auto it = v.swap_erase(v.begin() + 1);
+      expect(it == v.begin() + 1);
+      expect(v == SmallVector({1, 6, 3, 4, 5}));
+      it = v.swap_erase(v.end() - 1); // The last one has nothing to swap
+      expect(it == v.end());
+      expect(v == SmallVector({1, 6, 3, 4}));
+
+      SmallVector<Tracker> trackers;
+      for (int i = 0; i < 5; ++i) {
+        trackers.emplace_back(i);
+      }
+      Tracker::reset();
+      trackers.swap_erase(trackers.begin());
+      expect(Tracker::destructor_count == 1_i);
+      expect(Tracker::copy_count == 1_i) << "One move assignment";
+      expect(trackers[0].a_ == 4_i);
+      expect(trackers.size() == 4_u);
+    };
+
+    should("remove_if()/erase_if()") = [] {
+      SmallVector<int, 4> v = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+      expect(v.remove_if([](int x) { return x % 3 == 0; }) == 3_u);
+      expect(v == SmallVector({1, 2, 4, 5, 7, 8}));
+      expect(v.remove_if([](int x) { return x > 100; }) == 0_u);
+      expect(erase_if(v, [](int x) { return x < 3; }) == 2_u);
+      expect(v == SmallVector({4, 5, 7, 8}));
+      expect(erase(v, 7) == 1_u);
+      expect(v.remove(4) == 1_u);
+      expect(v == SmallVector({5, 8}));
+      expect(v.remove_if([](int) { return true; }) == 2_u);
+      expect(v.empty());
+
+      SmallVector<Tracker> trackers;
+      for (int i = 0; i < 6; ++i) {
+        trackers.emplace_back(i);
+      }
+      Tracker::reset();
+      trackers.remove_if([](const Tracker &t) { return t.a_ % 2 == 0; });
+      expect(Tracker::destructor_count == 3_i);
+      expect(Tracker::copy_count == 3_i) << "Each kept value moves once";
+      expect(trackers.size() == 3_u);
+      expect(trackers[0].a_ == 1_i && trackers[2].a_ == 5_i);
+
+      SmallVector<std::string, 2> strings = {"a", "bb", "c", "dd", "e"};
+      erase_if(strings, [](const std::string &s) { return s.size() == 2; });
+      expect(strings.size() == 3_u);
+      expect(strings[1] == "c" && strings[2] == "e");
+    };
+
+    should("insert()/erase() trivially relocatable") = [] {
+      SmallVector<Handle, 4> v;
+      for (int i = 0; i < 6; ++i) {
+        v.emplace(v.begin(), i); // Spills over partway through
+      }
+      expect(fatal(v.size() == 6_u));
+      for (int i = 0; i < 6; ++i) {
+        expect(*v[i].ptr == 5 - i);
+      }
+      v.erase(v.begin() + 1, v.begin() + 3);
+      expect(fatal(v.size() == 4_u));
+      expect(*v[0].ptr == 5_i);
+      expect(*v[1].ptr == 2_i);
+      expect(*v[3].ptr == 0_i);
+    };
+
     should("push_back()") = [] {
       SmallVector<int> v;
       const size_t static_size = v.get_static_size();
@@ -258,6 +758,88 @@ int main() {
       expect(v1 == SmallVector({1, 2, 3, 4, 5, 6, 7, 8}));
     };
 
+    should("append() our own values") = [] {
+      // Full, so appending has to move everything into a new heap block
+      SmallVector<std::string, 2> v = {"a", "b", "c"};
+      v.shrink_to_fit();
+      v.append(v);
+      expect(v == SmallVector<std::string>({"a", "b", "c", "a", "b", "c"}));
+      v.shrink_to_fit();
+      v.append_range(std::span(v.data() + 4, 2));
+      expect(v.size() == 8_u && v[6] == "b" && v[7] == "c");
+
+      SmallVector<int, 4> ints = {1, 2, 3, 4};
+      ints.append(ints);
+      ints.append_range(ints);
+      expect(ints.size() == 16_u && ints[15] == 4_i && ints[8] == 1_i);
+    };
+
+    should("append(&&) takes the heap block when empty") = [] {
+      SmallVector<std::string> empty;
+      SmallVector<std::string> big(20, "x");
+      const std::string *block = big.data();
+      empty.append(std::move(big));
+      expect(empty.data() == block);
+      expect(empty.size() == 20_u);
+      expect(big.empty() && big.is_array());
+
+      // Otherwise the values are moved over one by one
+      SmallVector<std::string> some = {"a"};
+      some.append(std::move(empty));
+      expect(some.size() == 21_u);
+      expect(some[0] == "a" && some[20] == "x");
+      expect(empty.empty());
+    };
+
+    should("append() streams huge runs") = [] {
+      // Big enough to go through simd::stream_copy(), and an odd size off an
+      // odd offset so there's a head and tail to copy as well
+      const size_t count = simd::STREAM_COPY_BYTES / sizeof(int) + 13;
+      SmallVector<int> big(count);
+      std::iota(big.begin(), big.end(), 0);
+      SmallVector<int> merged = {-1, -2, -3};
+      merged.append(big);
+      expect(merged.size() == count + 3);
+      expect(std::equal(big.begin(), big.end(), merged.begin() + 3));
+      merged.append(std::move(big));
+      expect(merged.size() == 2 * count + 3);
+      expect(merged.back() == static_cast<int>(count) - 1);
+      expect(merged[count + 3] == 0_i);
+    };
+
+    should("append() and == across static sizes") = [] {
+      SmallVector<int, 2> small = {1, 2};
+      SmallVector<int, 32> big = {1, 2};
+      expect(small == big && big == small);
+      big.push_back(3);
+      expect(small != big);
+      small.append(big);
+      expect(small.is_vector());
+      expect(small == SmallVector({1, 2, 1, 2, 3}));
+
+      SmallVector<std::string, 1> strings = {"a"};
+      SmallVector<std::string, 8> more = {"b", "c"};
+      strings.append(std::move(more));
+      expect(strings.size() == 3_u && strings[2] == "c");
+      expect(more.empty() && more.is_array());
+    };
+
+    should("emplace() one of our own values") = [] {
+      SmallVector<int, 8> inline_v = {1, 2, 3, 4};
+      inline_v.emplace(inline_v.begin(), inline_v.back());
+      inline_v.emplace(inline_v.begin() + 2, inline_v[0]);
+      expect(inline_v == SmallVector({4, 1, 4, 2, 3, 4}));
+
+      // Full, so the emplace moves everything into a new heap block
+      SmallVector<std::string, 2> heap = {"a", "b", "c", "d"};
+      heap.shrink_to_fit();
+      expect(heap.size() == heap.capacity());
+      heap.emplace(heap.begin(), heap.back());
+      heap.shrink_to_fit();
+      heap.emplace(heap.begin() + 1, heap[0]);
+      expect(heap == SmallVector<std::string>({"d", "d", "a", "b", "c", "d"}));
+    };
+
     should("pop_back()") = [] {
       SmallVector<int> v = {1, 2, 3, 4, 5};
       v.pop_back();
@@ -268,7 +850,8 @@ int main() {
     should("resize()") = [] {
       SmallVector<int> v;
       const size_t static_size = v.get_static_size();
-      const size_t expected_size = CACHE_LINE_SIZE_BYTES / sizeof(int);
+      const size_t expected_size =
+          (CACHE_LINE_SIZE_BYTES - header_size_bytes()) / sizeof(int);
       expect(static_size == expected_size);
       v.resize(static_size);
       expect(v.size() == expected_size);
@@ -278,6 +861,34 @@ int main() {
       expect(v.is_vector());
     };
 
+    should("resize_for_overwrite()") = [] {
+      SmallVector<char, 16> buffer = {'a', 'b'};
+      buffer.resize_for_overwrite(4096);
+      expect(buffer.size() == 4096_u);
+      expect(buffer[0] == 'a' && buffer[1] == 'b') << "Old values are kept";
+      std::fill(buffer.begin() + 2, buffer.end(), 'c');
+      expect(buffer.back() == 'c');
+      buffer.resize_for_overwrite(1);
+      expect(buffer.size() == 1_u);
+
+      SmallVector<int> v(20, default_init);
+      expect(v.size() == 20_u);
+
+      // Non trivial types are still default constructed
+      Tracker::reset();
+      SmallVector<Tracker> v2(3, default_init);
+      v2.resize_for_overwrite(5);
+      expect(Tracker::constructor_count == 5_i);
+    };
+
+    should("be moved, not copied, by a growing std::vector") = [] {
+      std::vector<SmallVector<std::string, 2>> outer(1);
+      outer[0].assign(10, "x");
+      const std::string *block = outer[0].data();
+      outer.resize(outer.capacity() + 1);
+      expect(outer[0].data() == block) << "the heap block was stolen";
+    };
+
     should("swap()") = [] {
       SmallVector<int> v1 = {1, 2, 3, 4, 5};
       SmallVector<int> v2 = {6, 7};
@@ -289,6 +900,1186 @@ int main() {
     };
   };
 
+  "[impl]"_test = [] {
+    should("take any static size as a SmallVectorImpl &") = [] {
+      SmallVector<int, 4> small;
+      SmallVector<int, 64> big;
+      expect(fill_with_counts(small, 10) == 9_u);
+      expect(fill_with_counts(big, 10) == 9_u);
+      expect(small.is_vector() && big.is_array());
+      expect(small == big && small.front() == 1_i && big.back() == 9_i);
+
+      // Growing, clearing and the like through the base land in the right
+      // storage, so the SmallVector itself can still shrink back
+      SmallVectorImpl<int> &impl = small;
+      impl.clear();
+      impl.push_back(42);
+      expect(small.shrink_to_inline() && small[0] == 42_i);
+    };
+
+    should("find the static storage for any layout") = [] {
+      SmallVector<char, 6, uint8_t> bytes;
+      SmallVector<uint16_t, 4, uint16_t> shorts;
+      pmr::SmallVector<int> resource;
+      SmallVector<double, 4, uint32_t, std::pmr::polymorphic_allocator<double>>
+          doubles;
+      for (int i = 0; i < 20; ++i) {
+        bytes.push_back('a');
+        shorts.push_back(1);
+        resource.push_back(i);
+        doubles.push_back(i);
+        const bool spilled = i >= 4;
+        expect(shorts.is_vector() == spilled && doubles.is_vector() == spilled);
+        expect(bytes.is_vector() == (i >= 6));
+        expect(resource.is_vector() ==
+               (i >= static_cast<int>(resource.get_static_size())));
+      }
+      bytes.resize(2);
+      shorts.resize(2);
+      resource.resize(2);
+      doubles.resize(2);
+      expect(bytes.shrink_to_inline() && shorts.shrink_to_inline() &&
+             resource.shrink_to_inline() && doubles.shrink_to_inline());
+      expect(bytes.is_array() && shorts.is_array() && resource.is_array() &&
+             doubles.is_array());
+    };
+  };
+
+  "[exceptions]"_test = [] {
+    using Safe = Fragile<true>;
+    using Unsafe = Fragile<false>;
+
+    should("leave us untouched if emplace()'s constructor throws") = [] {
+      Safe::reset();
+      SmallVector<Safe, 4> v = {1, 2, 3, 4};
+      const SmallVector<Safe, 4> before = v;
+      expect(throws([&] { v.emplace(v.begin() + 1, -1); }));
+      expect(std::ranges::equal(v, before));
+      expect(v.is_array()) << "Shouldn't have spilled for a value never made";
+    };
+
+    should("leave us untouched if an insert()'s copy throws") = [] {
+      for (size_t pos : {0u, 2u, 4u}) {
+        Safe::reset();
+        const std::list<Safe> values = {7, 7, 7, 7, 7, 7, 7};
+        SmallVector<Safe, 8> v = {1, 2, 3, 4};
+        const SmallVector<Safe, 8> before = v;
+        Safe::reset(3);
+        expect(throws([&] { v.insert(v.begin() + pos, 5, Safe(9)); }));
+        expect(std::ranges::equal(v, before)) << "count, in place, at" << pos;
+
+        Safe::reset(3);
+        expect(throws([&] {
+          v.insert(v.begin() + pos, values.begin(), values.end());
+        }));
+        expect(std::ranges::equal(v, before)) << "range, growing, at" << pos;
+
+        std::istringstream in("5 6 -1 8"); // Can't make a Fragile(-1)
+        expect(throws([&] {
+          v.insert(v.begin() + pos, std::istream_iterator<int>(in),
+                   std::istream_iterator<int>());
+        }));
+        expect(std::ranges::equal(v, before)) << "input range, at" << pos;
+      }
+    };
+
+    should("keep every value if a move-only T's move throws growing") = [] {
+      FragileMoveOnly::budget = std::numeric_limits<int>::max();
+      SmallVector<FragileMoveOnly, 2> v;
+      v.emplace_back(1);
+      v.emplace_back(2);
+      FragileMoveOnly::budget = 1; // The second value's move throws
+      expect(throws([&] { v.emplace_back(3); }));
+      // The first value was moved from, but is still ours to destruct, and
+      // nothing was destructed twice or leaked (which ASan would catch)
+      expect(v.size() == 2_u && v.is_array());
+      expect(*v[1].value == 2_i);
+      FragileMoveOnly::budget = std::numeric_limits<int>::max();
+      v.emplace_back(3);
+      v.shrink_to_fit();
+      expect(v.size() == 3_u && *v[2].value == 3_i);
+    };
+
+    should("copy to grow when T's move can throw") = [] {
+      Unsafe::reset();
+      SmallVector<Unsafe, 4> v = {1, 2, 3, 4};
+      Unsafe::reset();
+      v.reserve(16);
+      expect(Unsafe::move_count == 0_i);
+      expect(Unsafe::copy_count == 4_i);
+
+      Safe::reset();
+      SmallVector<Safe, 4> w = {1, 2, 3, 4};
+      Safe::reset();
+      w.reserve(16);
+      expect(Safe::copy_count == 0_i) << "Nothrow moves should be used";
+    };
+
+    should("leave us untouched if growing throws") = [] {
+      Unsafe::reset();
+      SmallVector<Unsafe, 4> v = {1, 2, 3, 4};
+      const SmallVector<Unsafe, 4> before = v;
+      Unsafe::reset(2);
+      expect(throws([&] { v.reserve(16); }));
+      expect(v.is_array());
+      expect(std::ranges::equal(v, before));
+
+      Unsafe::reset(3);
+      expect(throws([&] { v.push_back(5); }));
+      expect(v.is_array());
+      expect(std::ranges::equal(v, before));
+
+      Unsafe::reset(3);
+      expect(throws([&] { v.emplace(v.begin() + 2, 5); }));
+      expect(std::ranges::equal(v, before));
+    };
+
+    should("stay valid if a throwing move fails in place") = [] {
+      Unsafe::reset();
+      SmallVector<Unsafe, 8> v = {1, 2, 3, 4, 5};
+      Unsafe::reset(2);
+      expect(throws([&] { v.emplace(v.begin() + 1, 9); }));
+      expect(v.size() >= 1_u && v.size() <= 5_u);
+      for (size_t i = 0; i < v.size(); ++i) {
+        expect(v[i].value == static_cast<int>(i) + 1);
+      }
+    };
+  };
+
+  "[flat]"_test = [] {
+    should("SmallFlatSet insert()/find()/erase()") = [] {
+      SmallFlatSet<int> s;
+      expect(s.insert(5).second);
+      expect(s.insert(1).second);
+      expect(s.insert(3).second);
+      expect(!s.insert(3).second);
+      expect(s.size() == 3_u);
+      expect(std::is_sorted(s.begin(), s.end()));
+      expect(*s.find(3) == 3_i);
+      expect(s.find(4) == s.end());
+      expect(s.contains(1) && !s.contains(2));
+      expect(*s.lower_bound(2) == 3_i);
+      expect(*s.upper_bound(3) == 5_i);
+      expect(s.erase(3) == 1_u);
+      expect(s.erase(3) == 0_u);
+      expect(s == SmallFlatSet<int>{1, 5});
+    };
+
+    should("SmallFlatSet matches std::set") = [] {
+      // Sizes on both sides of the linear search cutoff
+      for (const int size : {0, 1, 7, 20, 40, 300}) {
+        std::set<int> expected;
+        SmallFlatSet<int> s;
+        for (int i = 0; i < size; ++i) {
+          const int key = (i * 37) % 101;
+          expected.insert(key);
+          s.insert(key);
+        }
+        expect(std::equal(s.begin(), s.end(), expected.begin(),
+                          expected.end()));
+        for (int key = -1; key <= 102; ++key) {
+          expect(s.contains(key) == expected.contains(key));
+          expect(s.lower_bound(key) - s.begin() ==
+                 std::distance(expected.begin(), expected.lower_bound(key)));
+          expect(s.upper_bound(key) - s.begin() ==
+                 std::distance(expected.begin(), expected.upper_bound(key)));
+        }
+      }
+    };
+
+    should("SmallFlatSet bulk insert()") = [] {
+      SmallFlatSet<std::string> s = {"m", "c", "x"};
+      const std::vector<std::string> more = {"a", "c", "z", "a", "n", "b"};
+      s.insert(more.begin(), more.end());
+      const std::vector<std::string> expected = {"a", "b", "c", "m",
+                                                 "n", "x", "z"};
+      expect(std::equal(s.begin(), s.end(), expected.begin(),
+                        expected.end()));
+      // All on the end, so nothing to merge
+      s.insert({"zz", "zzz"});
+      expect(s.size() == 9_u && s.keys().back() == "zzz");
+
+      SmallFlatSet<int> big;
+      std::set<int> expected_big;
+      for (int round = 0; round < 5; ++round) {
+        std::vector<int> keys;
+        for (int i = 0; i < 50; ++i) {
+          keys.push_back((i * 7919 + round * 31) % 500);
+        }
+        big.insert(keys.begin(), keys.end());
+        expected_big.insert(keys.begin(), keys.end());
+        expect(std::equal(big.begin(), big.end(), expected_big.begin(),
+                          expected_big.end()));
+      }
+    };
+
+    should("SmallFlatSet with a custom comparison") = [] {
+      SmallFlatSet<int, 8, std::greater<int>> s = {1, 3, 2, 3};
+      expect(s.size() == 3_u);
+      expect(*s.begin() == 3_i);
+      expect(s.contains(2) && !s.contains(4));
+    };
+
+    should("SmallFlatMap operator[]/at()/find()") = [] {
+      SmallFlatMap<int, std::string> m;
+      m[3] = "three";
+      m[1] = "one";
+      m[2] = "two";
+      expect(m.size() == 3_u);
+      expect(m.at(1) == "one");
+      expect(throws([&m] { m.at(4); }));
+      expect((*m.begin()).first == 1_i);
+      expect(m.find(2)->second == "two");
+      expect(m.find(4) == m.end());
+      m.find(2)->second = "TWO";
+      expect(m[2] == "TWO");
+      expect(std::is_sorted(m.keys().begin(), m.keys().end()));
+
+      expect(!m.try_emplace(1, "uno").second);
+      expect(m.at(1) == "one");
+      expect(!m.insert_or_assign(1, "uno").second);
+      expect(m.at(1) == "uno");
+      expect(m.insert({0, "zero"}).second);
+      expect(m.erase(2) == 1_u);
+      expect(m.erase(2) == 0_u);
+
+      std::vector<int> keys;
+      for (const auto &[key, value] : std::as_const(m)) {
+        keys.push_back(key);
+      }
+      expect(keys == std::vector<int>{0, 1, 3});
+    };
+
+    should("SmallFlatMap keeps keys and values in step on a throw") = [] {
+      using Value = Fragile<true>;
+      SmallFlatMap<int, Value> m;
+      m.try_emplace(1, 10);
+      m.try_emplace(3, 30);
+      expect(throws([&m] { m.try_emplace(2, -1); }));
+      expect(m.keys().size() == 2_u && m.values().size() == 2_u);
+      expect(m.at(3).value == 30_i && !m.contains(2));
+
+      const std::vector<std::pair<int, Value>> more = {
+          {0, 0}, {2, 20}, {4, 40}};
+      Value::reset(1); // The second value's copy throws
+      expect(throws([&] { m.insert(more.begin(), more.end()); }));
+      Value::reset();
+      expect(m.keys().size() == 2_u && m.values().size() == 2_u);
+      expect(m.at(1).value == 10_i && m.at(3).value == 30_i);
+      m.insert(more.begin(), more.end());
+      expect(m.size() == 5_u && m.at(2).value == 20_i);
+    };
+
+    should("SmallFlatMap matches std::map") = [] {
+      for (const int size : {0, 1, 7, 20, 40, 300}) {
+        std::map<int64_t, int> expected;
+        SmallFlatMap<int64_t, int> m;
+        std::vector<std::pair<int64_t, int>> bulk;
+        // Entries going in one at a time or in bulk, and either way the
+        // first value for a key wins
+        auto flush = [&] {
+          m.insert(bulk.begin(), bulk.end());
+          expected.insert(bulk.begin(), bulk.end());
+          bulk.clear();
+        };
+        for (int i = 0; i < size; ++i) {
+          const int64_t key = (i * 37) % 101;
+          if (i % 2 == 0) {
+            m.try_emplace(key, i);
+            expected.try_emplace(key, i);
+          } else {
+            bulk.emplace_back(key, i);
+          }
+          if (bulk.size() == 10)
+            flush();
+        }
+        flush();
+        expect(m.size() == expected.size());
+        for (const auto &[key, value] : expected) {
+          expect(m.at(key) == value);
+        }
+        expect(!m.contains(-1) && !m.contains(101));
+        expect(std::is_sorted(m.keys().begin(), m.keys().end()));
+      }
+    };
+
+    should("SmallFlatMap bulk insert() keeps the first value") = [] {
+      SmallFlatMap<std::string, int> m = {{"b", 1}, {"d", 2}};
+      const std::vector<std::pair<std::string, int>> more = {
+          {"c", 3}, {"a", 4}, {"d", 5}, {"c", 6}, {"e", 7}};
+      m.insert(more.begin(), more.end());
+      const std::vector<std::string> keys = {"a", "b", "c", "d", "e"};
+      const std::vector<int> values = {4, 1, 3, 2, 7};
+      expect(std::equal(m.keys().begin(), m.keys().end(), keys.begin(),
+                        keys.end()));
+      expect(std::equal(m.values().begin(), m.values().end(), values.begin(),
+                        values.end()));
+    };
+  };
+
+  "[soa]"_test = [] {
+    should("column layout and static size") = [] {
+      using Layout = SoALayout<char, double, int16_t>;
+      expect(Layout::offset(0, 3) == 0_u);
+      expect(Layout::offset(1, 3) == 8_u);  // 3 chars, padded to 8
+      expect(Layout::offset(2, 3) == 32_u); // then 3 doubles
+      expect(Layout::bytes(3) == 38_u);
+      expect(sizeof(SmallSoAVector<float, float, float>) <= 64_u);
+      expect(SmallSoAVector<float, float, float>::get_static_size() == 3_u);
+      expect(sizeof(SmallSoAVector<char, double, int16_t>) <= 64_u);
+    };
+
+    should("push_back() inline then spill over") = [] {
+      SmallSoAVectorN<4, int, double> soa;
+      for (int i = 0; i < 4; ++i) {
+        soa.push_back(i, i * 0.5);
+      }
+      expect(soa.is_array());
+      soa.emplace_back(4, 2.0);
+      expect(soa.is_vector());
+      expect(soa.size() == 5_u);
+      const std::span<int> ids = soa.column<0>();
+      const std::span<double> halves = soa.column<1>();
+      for (size_t i = 0; i < soa.size(); ++i) {
+        expect(ids[i] == static_cast<int>(i));
+        expect(halves[i] == i * 0.5);
+      }
+      expect(reinterpret_cast<uintptr_t>(halves.data()) % alignof(double) ==
+             0_u);
+    };
+
+    should("undo a half built row if a column throws") = [] {
+      SmallSoAVectorN<4, Tracker, Fragile<true>, Tracker> soa;
+      soa.emplace_back(1, 1, 1);
+      Tracker::reset();
+      expect(throws([&] { soa.emplace_back(2, -1, 2); }));
+      expect(Tracker::constructor_count == 1_i);
+      expect(Tracker::destructor_count == 1_i) << "the first column is undone";
+      expect(soa.size() == 1_u);
+      soa.emplace_back(3, 3, 3);
+      expect(soa.size() == 2_u && soa.column<0>()[1].a_ == 3_i);
+    };
+
+    should("keep every row if a column throws moving or copying") = [] {
+      static_assert(
+          std::is_nothrow_move_constructible_v<SmallSoAVectorN<2, int>>);
+      using Soa = SmallSoAVectorN<2, Tracker, Fragile<false>>;
+      static_assert(!std::is_nothrow_move_constructible_v<Soa>);
+      const auto made = [] {
+        return Tracker::constructor_count + Tracker::copy_count +
+               Tracker::move_count;
+      };
+      Soa soa;
+      soa.emplace_back(1, 1);
+      soa.emplace_back(2, 2);
+      Tracker::reset();
+      Fragile<false>::reset(1); // The second column throws spilling over
+      expect(throws([&] { soa.emplace_back(3, 3); }));
+      expect(soa.is_array() && soa.size() == 2_u);
+      expect(soa.column<0>()[1].a_ == 2_i && soa.column<1>()[1].value == 2_i);
+      expect(made() == Tracker::destructor_count) << "the copies are undone";
+
+      Fragile<false>::reset(1);
+      expect(throws([&] { Soa copy = soa; }));
+      expect(made() == Tracker::destructor_count);
+      Fragile<false>::reset();
+      soa.emplace_back(3, 3);
+      expect(soa.is_vector() && soa.size() == 3_u);
+    };
+
+    should("zipped iteration") = [] {
+      SmallSoAVectorN<2, int, std::string> soa;
+      for (int i = 0; i < 6; ++i) {
+        soa.push_back(i, std::to_string(i));
+      }
+      for (auto [id, name] : soa) {
+        name += "!";
+        id *= 10;
+      }
+      int expected = 0;
+      for (const auto &[id, name] : std::as_const(soa)) {
+        expect(id == expected * 10);
+        expect(name == std::to_string(expected) + "!");
+        ++expected;
+      }
+      expect(expected == 6_i);
+      expect(std::get<1>(soa[2]) == "2!");
+      expect(soa.end() - soa.begin() == 6_i);
+    };
+
+    should("erase()/pop_back()/resize()") = [] {
+      SmallSoAVectorN<2, int, std::string> soa;
+      for (int i = 0; i < 5; ++i) {
+        soa.push_back(i, std::to_string(i));
+      }
+      soa.erase(1);
+      soa.pop_back();
+      expect(soa.size() == 3_u);
+      expect(std::get<1>(soa[1]) == "2");
+      expect(std::get<0>(soa.back()) == 3_i);
+      soa.resize(5);
+      expect(std::get<1>(soa[4]).empty());
+      soa.resize(1);
+      expect(soa.size() == 1_u && std::get<1>(soa.front()) == "0");
+    };
+
+    should("copy/move in both modes") = [] {
+      for (const int count : {2, 9}) {
+        SmallSoAVectorN<4, int, std::string> soa;
+        for (int i = 0; i < count; ++i) {
+          soa.push_back(i, std::to_string(i));
+        }
+        SmallSoAVectorN<4, int, std::string> copy = soa;
+        SmallSoAVectorN<4, int, std::string> moved = std::move(soa);
+        expect(soa.empty());
+        expect(moved.size() == static_cast<size_t>(count));
+        for (int i = 0; i < count; ++i) {
+          expect(std::get<1>(copy[i]) == std::to_string(i));
+          expect(std::get<1>(moved[i]) == std::to_string(i));
+        }
+        copy.swap(soa);
+        expect(copy.empty() && soa.size() == static_cast<size_t>(count));
+        soa = moved;
+        expect(std::get<0>(soa.at(count - 1)) == count - 1);
+        expect(throws([&soa] { soa.at(100); }));
+      }
+    };
+  };
+
+  "[stable]"_test = [] {
+    static_assert(
+        std::random_access_iterator<SmallStableVector<int>::iterator>);
+    static_assert(
+        std::random_access_iterator<SmallStableVector<int>::const_iterator>);
+
+    should("keep values in place as it grows") = [] {
+      SmallStableVector<int, 4> v;
+      SmallVector<int *> addresses;
+      for (int i = 0; i < 1000; ++i) {
+        addresses.push_back(&v.emplace_back(i));
+      }
+      expect(fatal(v.size() == 1000_u));
+      expect(v.capacity() == 1024_u) << "4 inline, then doubling chunks";
+      for (int i = 0; i < 1000; ++i) {
+        expect(&v[i] == addresses[i]);
+        expect(*addresses[i] == i);
+      }
+      expect(v.front() == 0_i && v.back() == 999_i);
+      expect(throws<std::out_of_range>([&] { v.at(1000); }));
+    };
+
+    should("iterate across chunks") = [] {
+      SmallStableVector<int, 3> v;
+      for (int i = 0; i < 50; ++i) {
+        v.push_back(i);
+      }
+      expect(std::accumulate(v.begin(), v.end(), 0) == 1225_i);
+      expect(v.end() - v.begin() == 50_i);
+      expect(*(v.begin() + 20) == 20_i);
+      expect(*std::find(v.cbegin(), v.cend(), 33) == 33_i);
+      expect(*v.rbegin() == 49_i);
+      auto it = v.begin() + 2; // Stays pointing at [2] as we grow
+      for (int i = 50; i < 100; ++i) {
+        v.push_back(i);
+      }
+      expect(*it == 2_i);
+
+      SmallVector<size_t> chunks;
+      std::as_const(v).for_each_chunk([&](std::span<const int> values) {
+        chunks.push_back(values.size());
+      });
+      expect(chunks == SmallVector<size_t>({3, 3, 6, 12, 24, 48, 4}));
+    };
+
+    should("copy(), move(), pop_back(), resize() and destruct") = [] {
+      Tracker::reset();
+      {
+        SmallStableVector<Tracker, 2> v;
+        for (int i = 0; i < 7; ++i) {
+          v.emplace_back(i);
+        }
+        const Tracker *heap_value = &v[5];
+        SmallStableVector<Tracker, 2> copy = v;
+        expect(copy.size() == 7_u);
+        expect(copy[6].a_ == 6_i);
+        SmallStableVector<Tracker, 2> moved = std::move(v);
+        expect(v.empty());
+        expect(&moved[5] == heap_value) << "Heap chunks should be stolen";
+        expect(moved[1].a_ == 1_i);
+        moved.pop_back();
+        expect(moved.size() == 6_u);
+        moved.resize(3);
+        moved.shrink_to_fit();
+        expect(moved.capacity() == 4_u);
+        moved.resize(10);
+        copy = moved;
+        expect(copy.size() == 10_u && copy[2].a_ == 2_i);
+        v = std::move(copy);
+        expect(v.size() == 10_u && copy.empty());
+        v.clear();
+        expect(v.capacity() >= 10_u) << "clear() keeps the chunks";
+      }
+      expect(Tracker::destructor_count ==
+             Tracker::constructor_count + Tracker::copy_count +
+                 Tracker::move_count);
+    };
+  };
+
+  "[string]"_test = [] {
+    should("fill a cache line and stay inline when short") = [] {
+      expect(sizeof(SmallString<>) == CACHE_LINE_SIZE_BYTES);
+      SmallString<> s = "config/path/to/key";
+      expect(s.is_array());
+      expect(s.size() == 18_u);
+      expect(std::string_view(s.c_str()) == "config/path/to/key");
+      s.append(std::string(SmallString<>::get_static_size() - s.size(), 'x'));
+      expect(s.is_array()) << "Exactly full should still be inline";
+      expect(s.c_str()[s.size()] == '\0');
+      s += 'y';
+      expect(s.is_vector());
+      expect(s.back() == 'y');
+      expect(std::strlen(s.c_str()) == s.size());
+    };
+
+    should("append()/+=/push_back()/pop_back()/resize()") = [] {
+      SmallString<8> s;
+      expect(s.empty());
+      expect(*s.c_str() == '\0');
+      s += "key";
+      s += '=';
+      s.append(3, '1');
+      const std::list<char> more = {'2', '3'};
+      s.append(more.begin(), more.end());
+      expect(s == "key=11123");
+      s.pop_back();
+      expect(s.view() == "key=1112");
+      s.resize(3);
+      expect(s == "key" && std::strlen(s.c_str()) == 3_u);
+      s.resize(5, '!');
+      expect(s == "key!!");
+      s.clear();
+      expect(s.empty() && *s.c_str() == '\0');
+      for (char c : std::string_view("abcdefghij")) {
+        s.push_back(c);
+      }
+      expect(s == "abcdefghij");
+      expect(s.at(9) == 'j');
+      expect(throws<std::out_of_range>([&] { s.at(10); }));
+    };
+
+    should("append() its own chars") = [] {
+      SmallString<4> s = "abc";
+      s.append(s); // Grows, so it has to copy them out first
+      expect(s == "abcabc");
+      s.reserve(100);
+      s += std::string_view(s).substr(1, 2); // Fits, so appended in place
+      expect(s == "abcabcbc");
+      s = std::string_view(s).substr(3);
+      expect(s == "abcbc");
+    };
+
+    should("copy/move/compare/hash") = [] {
+      SmallString<4> a = "hello world";
+      SmallString<4> b = a;
+      expect(b == a && b.data() != a.data());
+      SmallString<4> c = std::move(b);
+      expect(c == a);
+      expect(b.empty() && *b.c_str() == '\0');
+      b += "fine";
+      expect(b == "fine");
+      expect(a < "hello x");
+      expect("hello" < a);
+      expect(a != b);
+      expect(c.str() == std::string("hello world"));
+
+      std::unordered_set<SmallString<>> keys = {"a", "b", "a"};
+      expect(keys.size() == 2_u);
+      expect(keys.contains("b"));
+      expect(std::hash<SmallString<>>()("key") ==
+             std::hash<std::string_view>()("key"));
+    };
+
+    should("be written into through std::back_inserter()") = [] {
+      SmallString<> s = "id=";
+      char digits[16];
+      const auto [end, ec] = std::to_chars(digits, digits + 16, 12345);
+      expect(ec == std::errc());
+      std::copy(digits, end, std::back_inserter(s));
+      expect(s == "id=12345");
+      std::ranges::copy(std::string_view(" ok"), std::back_inserter(s));
+      expect(s == "id=12345 ok");
+    };
+  };
+
+  "[concurrent]"_test = [] {
+    should("push_back() from one thread") = [] {
+      ConcurrentSmallVector<std::string, 2> v;
+      std::string &first = v.push_back("0");
+      for (int i = 1; i < 40; ++i) {
+        v.push_back(std::to_string(i));
+      }
+      expect(&first == &v[0]) << "values never move";
+      expect(v.size() == 40_u);
+      size_t values = 0;
+      v.for_each_segment([&values](std::span<std::string> segment) {
+        values += segment.size();
+      });
+      expect(values == 40_u);
+
+      SmallVector<std::string, 2> frozen = v.freeze();
+      expect(v.empty());
+      expect(frozen.size() == 40_u);
+      for (size_t i = 0; i < frozen.size(); ++i) {
+        expect(frozen[i] == std::to_string(i));
+      }
+      v.push_back("again");
+      expect(v.size() == 1_u && v[0] == "again");
+    };
+
+    should("not count a value whose constructor threw") = [] {
+      using Value = Fragile<true>;
+      ConcurrentSmallVector<Value, 2> v;
+      v.emplace_back(1);
+      expect(throws([&] { v.emplace_back(-1); }));
+      const Value copied(2);
+      Value::reset(0);
+      expect(throws([&] { v.push_back(copied); }));
+      Value::reset();
+      expect(v.size() == 1_u);
+      for (int i = 2; i < 6; ++i) {
+        v.emplace_back(i);
+      }
+      expect(v.size() == 5_u && v[1].value == 2_i && v[4].value == 5_i);
+    };
+
+    should("push_back() from many threads") = [] {
+      constexpr int THREADS = 8;
+      constexpr int PER_THREAD = 2000;
+      ConcurrentSmallVector<int> v;
+      std::vector<std::thread> threads;
+      std::vector<std::vector<int *>> refs(THREADS);
+      for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&v, &refs, t] {
+          for (int i = 0; i < PER_THREAD; ++i) {
+            refs[t].push_back(&v.push_back(t * PER_THREAD + i));
+          }
+        });
+      }
+      for (std::thread &thread : threads) {
+        thread.join();
+      }
+      expect(v.size() == static_cast<size_t>(THREADS * PER_THREAD));
+      // Every reference handed out still points at its own value
+      bool refs_stable = true;
+      for (int t = 0; t < THREADS; ++t) {
+        for (int i = 0; i < PER_THREAD; ++i) {
+          refs_stable &= *refs[t][i] == t * PER_THREAD + i;
+        }
+      }
+      expect(refs_stable);
+
+      auto frozen = v.freeze();
+      std::sort(frozen.begin(), frozen.end());
+      bool all_there = true;
+      for (int i = 0; i < THREADS * PER_THREAD; ++i) {
+        all_there &= frozen[i] == i;
+      }
+      expect(all_there);
+    };
+  };
+
+  "[parallel]"_test = [] {
+    // Small thresholds, so the (small) test inputs take the threaded path,
+    // and always a few threads, even on a single core machine
+    constexpr size_t THRESHOLD = 1000;
+    constexpr int COUNT = 100'000;
+    parallel::max_threads = 4;
+
+    should("for_each()/transform()/reduce() every value") = [] {
+      SmallVector<int> v(COUNT);
+      std::iota(v.begin(), v.end(), 0);
+      parallel::for_each(v, [](int &x) { x *= 2; }, THRESHOLD);
+      bool doubled = true;
+      for (int i = 0; i < COUNT; ++i) {
+        doubled = doubled && v[i] == 2 * i;
+      }
+      expect(doubled);
+
+      SmallVector<int64_t> squares(v.size());
+      const auto square = [](int x) { return int64_t(x) * x; };
+      auto end = parallel::transform(v, squares.begin(), square, THRESHOLD);
+      expect(end == squares.end());
+      expect(squares[COUNT - 1] == square(v[COUNT - 1]));
+
+      const int64_t sum =
+          parallel::reduce(v, int64_t(0), std::plus<>(), THRESHOLD);
+      expect(sum == int64_t(COUNT) * (COUNT - 1));
+      expect(parallel::reduce(v, int64_t(0)) == sum) << "Sequential path";
+
+      SmallVector<int> small = {1, 2, 3};
+      parallel::for_each(small, [](int &x) { x += 1; });
+      expect(small == SmallVector({2, 3, 4}));
+    };
+
+    should("sort() like std::sort()") = [] {
+      std::mt19937 rng(42);
+      for (size_t count : {THRESHOLD, size_t(12'345), size_t(COUNT)}) {
+        SmallVector<uint32_t> v(count);
+        std::generate(v.begin(), v.end(), rng);
+        SmallVector<uint32_t> expected = v;
+        std::sort(expected.begin(), expected.end(), std::greater<>());
+        parallel::sort(v, std::greater<>(), THRESHOLD);
+        expect(std::ranges::equal(v, expected)) << "count" << count;
+      }
+
+      // Any static size, as it takes a SmallVectorImpl
+      SmallVector<uint32_t, 8> small(COUNT);
+      std::generate(small.begin(), small.end(), rng);
+      parallel::sort(small, std::less<>(), THRESHOLD);
+      expect(std::is_sorted(small.begin(), small.end()));
+    };
+
+#ifndef SMALLVECTOR_USE_STD_EXECUTION
+    should("pass on an exception thrown by any block") = [] {
+      SmallVector<int> v(COUNT);
+      std::iota(v.begin(), v.end(), 0);
+      expect(throws<std::runtime_error>([&] {
+        parallel::for_each(
+            v,
+            [](int x) {
+              if (x == COUNT / 2)
+                throw std::runtime_error("Bad value");
+            },
+            THRESHOLD);
+      }));
+    };
+
+    should("pass on an exception thrown while sort() merges") = [] {
+      // 4 runs of COUNT / 4, and values from different runs are only ever
+      // compared when merging, which is when this throws
+      SmallVector<int> v(COUNT);
+      std::iota(v.begin(), v.end(), 0);
+      const auto run_of = [](int x) { return x / (COUNT / 4); };
+      expect(throws<std::runtime_error>([&] {
+        parallel::sort(
+            v,
+            [&run_of](int a, int b) {
+              if (run_of(a) != run_of(b))
+                throw std::runtime_error("Merging");
+              return a > b;
+            },
+            THRESHOLD);
+      }));
+    };
+#endif
+
+    parallel::max_threads = 0;
+  };
+
+  "[serialize]"_test = [] {
+    should("as_span()/as_bytes()") = [] {
+      SmallVector<int, 4> v = {1, 2, 3};
+      expect(v.as_span().data() == v.data());
+      expect(v.as_span().size() == 3_u);
+      expect(v.as_bytes().size() == 3 * sizeof(int));
+      expect(v.as_bytes().data() ==
+             reinterpret_cast<const std::byte *>(v.data()));
+      expect(v.as_writable_bytes().data() ==
+             reinterpret_cast<std::byte *>(v.data()));
+    };
+
+    should("serialize() then deserialize() in both modes") = [] {
+      for (const int count : {0, 3, 50}) {
+        SmallVector<Simple, 4> v;
+        for (int i = 0; i < count; ++i) {
+          v.push_back({i, -i});
+        }
+        std::vector<std::byte> buffer(serialized_size(v));
+        expect(serialize(v, buffer) == buffer.size());
+        expect(read_wire_prefix(buffer) == static_cast<uint64_t>(count));
+
+        SmallVector<Simple, 4> out;
+        expect(deserialize(buffer, out) == buffer.size());
+        expect(out.size() == static_cast<size_t>(count));
+        expect(out.is_array() == (count <= 4));
+        if (count > 4)
+          expect(out.capacity() == static_cast<size_t>(count))
+              << "Allocates exactly once";
+        bool same = true;
+        for (int i = 0; i < count; ++i) {
+          same &= out[i].a == i && out[i].b == -i;
+        }
+        expect(same);
+      }
+    };
+
+    should("deserialize() rejects truncated input") = [] {
+      SmallVector<int> v = {1, 2, 3};
+      std::vector<std::byte> buffer(serialized_size(v));
+      serialize(v, buffer);
+      SmallVector<int> out;
+      expect(throws([&] {
+        deserialize(std::span(buffer).first(buffer.size() - 1), out);
+      }));
+      expect(throws([&] { deserialize(std::span(buffer).first(4), out); }));
+      expect(throws([&] {
+        std::array<std::byte, 4> small;
+        serialize(v, small);
+      }));
+    };
+
+    should("serialize through a SmallVectorImpl") = [] {
+      SmallVector<int, 2> v = {1, 2, 3};
+      SmallVector<int, 8> out;
+      SmallVectorImpl<int> &from = v;
+      SmallVectorImpl<int> &into = out;
+      std::vector<std::byte> buffer(serialized_size(from));
+      serialize(from, buffer);
+      expect(deserialize(buffer, into) == buffer.size());
+      expect(out == SmallVector<int, 8>{1, 2, 3} && out.is_array());
+    };
+
+    should("SmallVectorRef") = [] {
+      SmallVector<int, 4> v = {4, 5, 6, 5, 7, 8};
+      SmallVectorRef<int> ref = v;
+      expect(ref.data() == v.data());
+      expect(ref.size() == 6_u);
+      expect(ref[2] == 6_i && ref.at(5) == 8_i && ref.back() == 8_i);
+      expect(throws([ref] { ref.at(6); }));
+      expect(ref.find(5) - ref.begin() == 1_i);
+      expect(ref.contains(7) && !ref.contains(9));
+      expect(ref.count(5) == 2_u);
+      expect(ref == SmallVectorRef<int>(v.as_span()));
+      expect(ref != SmallVectorRef<int>(v.data(), 5));
+      expect(std::equal(ref.rbegin(), ref.rend(), v.rbegin(), v.rend()));
+      const SmallVectorImpl<int> &impl = v;
+      expect(SmallVectorRef<int>(impl) == ref);
+    };
+
+    should("index_wire_vectors() views serialized vectors in place") = [] {
+      std::vector<std::byte> buffer;
+      for (int count : {3, 0, 10}) {
+        SmallVector<int32_t, 4> v;
+        for (int i = 0; i < count; ++i) {
+          v.push_back(count * 100 + i);
+        }
+        const size_t offset = buffer.size();
+        buffer.resize(offset + serialized_size(v));
+        serialize(v, std::span(buffer).subspan(offset));
+      }
+      const auto refs = index_wire_vectors<int32_t>(buffer);
+      expect(fatal(refs.size() == 3_u));
+      expect(refs[0].size() == 3_u && refs[0][2] == 302_i);
+      expect(refs[1].empty());
+      expect(refs[2].size() == 10_u && refs[2][9] == 1009_i);
+      expect(reinterpret_cast<const std::byte *>(refs[2].data()) >=
+                 buffer.data() &&
+             reinterpret_cast<const std::byte *>(refs[2].data()) <
+                 buffer.data() + buffer.size())
+          << "Points into the buffer, no copy";
+
+      std::vector<std::byte> truncated(buffer.begin(), buffer.end() - 1);
+      expect(throws([&] { index_wire_vectors<int32_t>(truncated); }));
+    };
+
+#ifdef SMALLVECTOR_HAS_MMAP
+    should("MappedFile") = [] {
+      char path[] = "/tmp/smallvector_test_XXXXXX";
+      const int fd = mkstemp(path);
+      expect(fatal(fd >= 0));
+      SmallVector<int64_t> v = {1, 1, 2, 3, 5, 8, 13, 21, 34, 55};
+      std::vector<std::byte> buffer(serialized_size(v));
+      serialize(v, buffer);
+      expect(write(fd, buffer.data(), buffer.size()) ==
+             static_cast<ssize_t>(buffer.size()));
+      close(fd);
+      {
+        MappedFile file(path);
+        const auto refs = index_wire_vectors<int64_t>(file.bytes());
+        expect(fatal(refs.size() == 1_u));
+        expect(refs[0] == SmallVectorRef<int64_t>(v));
+        expect(refs[0].find(21) - refs[0].begin() == 7_i);
+      }
+      std::remove(path);
+      expect(throws([&] { MappedFile missing(path); }));
+    };
+#endif
+
+#ifdef SMALLVECTOR_HAS_IOVEC
+    should("write_to()/read_into() through a pipe") = [] {
+      int fds[2];
+      expect(fatal(pipe(fds) == 0));
+      SmallVector<int64_t, 4> v;
+      for (int64_t i = 0; i < 20; ++i) {
+        v.push_back(i * i);
+      }
+      WirePrefix prefix;
+      iovec out[2];
+      write_to(out, prefix, v);
+      expect(writev(fds[1], out, 2) ==
+             static_cast<ssize_t>(serialized_size(v)));
+
+      WirePrefix in_prefix;
+      expect(read(fds[0], in_prefix.data(), in_prefix.size()) ==
+             static_cast<ssize_t>(in_prefix.size()));
+      SmallVector<int64_t, 4> got;
+      iovec in;
+      read_into(in, got, read_wire_prefix(in_prefix));
+      expect(readv(fds[0], &in, 1) == static_cast<ssize_t>(in.iov_len));
+      expect(got.size() == 20_u);
+      expect(std::equal(got.begin(), got.end(), v.begin(), v.end()));
+      close(fds[0]);
+      close(fds[1]);
+    };
+#endif
+  };
+
+  "[allocators]"_test = [] {
+    should("pmr::SmallVector") = [] {
+      std::byte buffer[1024];
+      std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer));
+      pmr::SmallVector<int, 4> v(&resource);
+      for (int i = 0; i < 10; ++i) {
+        v.push_back(i);
+      }
+      expect(fatal(v.is_vector()));
+      const auto *block = reinterpret_cast<const std::byte *>(v.data());
+      expect(block >= buffer && block < buffer + sizeof(buffer))
+          << "Heap block should come from the resource";
+      expect(v.get_allocator().resource() == &resource);
+      expect(v[9] == 9_i);
+    };
+
+    should("ArenaSmallVector") = [] {
+      MonotonicArena arena(256);
+      ArenaSmallVector<int, 4> v1(arena);
+      ArenaSmallVector<int, 4> v2(arena);
+      for (int i = 0; i < 100; ++i) {
+        v1.push_back(i);
+        v2.push_back(-i);
+      }
+      expect(v1.size() == 100_u);
+      expect(v1[99] == 99_i);
+      expect(v2[99] == -99_i);
+
+      // Same arena, so moving can steal the heap block
+      const int *block = v1.data();
+      ArenaSmallVector<int, 4> v3(std::move(v1));
+      expect(v3.data() == block);
+    };
+
+    should("MonotonicArena refuses sizes it can't add a chunk for") = [] {
+      MonotonicArena arena(256);
+      expect(throws<std::bad_alloc>([&] { arena.allocate(SIZE_MAX - 8, 8); }));
+      expect(arena.allocate(1000, 8) != nullptr) << "still usable after";
+    };
+
+    should("CachedSmallVector reuses freed heap blocks") = [] {
+      ThreadBufferCache::trim();
+      ThreadBufferCache::reset_stats();
+      const int *first_block = nullptr;
+      for (int round = 0; round < 3; ++round) {
+        CachedSmallVector<int, 4> v;
+        for (int i = 0; i < 20; ++i) {
+          v.push_back(i);
+        }
+        expect(v[19] == 19_i);
+        if (round == 0)
+          first_block = v.data();
+        expect(v.data() == first_block) << "Same sized block comes back";
+      }
+      const ThreadBufferCache::Stats stats = ThreadBufferCache::stats();
+      // Each round grows 4 -> 8 -> 16 -> 32, and only the first round has to
+      // go to operator new
+      expect(stats.misses == 3_u);
+      expect(stats.hits == 6_u);
+
+      // Too big to cache
+      CachedSmallVector<int, 4> big;
+      big.reserve(ThreadBufferCache::MAX_BLOCK_BYTES);
+      expect(ThreadBufferCache::stats().misses == 3_u);
+      ThreadBufferCache::trim();
+    };
+
+    should("ThreadBufferCache size classes") = [] {
+      expect(ThreadBufferCache::block_bytes(1) == 16_u);
+      expect(ThreadBufferCache::block_bytes(17) == 32_u);
+      expect(ThreadBufferCache::block_bytes(64) == 64_u);
+      expect(ThreadBufferCache::is_cacheable(64 * 1024));
+      expect(!ThreadBufferCache::is_cacheable(64 * 1024 + 1));
+      expect(sizeof(CachedSmallVector<int>) == sizeof(SmallVector<int>));
+    };
+  };
+
+  "[instrumentation]"_test = [] {
+    using Counted = SmallVector<int, 4, size_t, std::allocator<int>, GrowBy2,
+                                CountingInstrumentation<TestSite>>;
+    SpillStats &stats = CountingInstrumentation<TestSite>::stats();
+    stats.reset();
+
+    should("count spills") = [&stats] {
+      {
+        Counted v;
+        for (int i = 0; i < 9; ++i) {
+          v.push_back(i); // Spills at 5, reallocates at 9
+        }
+      }
+      { Counted v = {1, 2}; }
+      expect(stats.spillovers.load() == 1_u);
+      expect(stats.reallocations.load() == 1_u);
+      expect(stats.relocated_values.load() == 12_u);
+      expect(stats.releases.load() == 2_u);
+      expect(stats.peak_size.load() == 9_u);
+      expect(stats.size_histogram[9].load() == 1_u);
+      expect(stats.size_histogram[2].load() == 1_u);
+      expect(stats.percentile(50) == 2_u);
+      expect(stats.percentile(100) == 9_u);
+    };
+
+    should("dump") = [&stats] {
+      std::ostringstream os;
+      dump_spill_stats(os);
+      expect(os.str().find("test.site: spillovers=1") != std::string::npos);
+      expect(SpillStats::bucket_of(100) == SpillStats::bucket_of(127));
+      expect(SpillStats::bucket_max(SpillStats::bucket_of(100)) == 127_u);
+    };
+
+    should("write_profiled_sizes()") = [] {
+      std::ostringstream os;
+      write_profiled_sizes(os);
+      expect(os.str().find("{\"test.site\", 9},") != std::string::npos)
+          << "p95 of sizes 2 and 9 is 9";
+
+      if constexpr (SMALLVECTOR_HARDENING < 2) {
+        // 9 ints after the 24 byte header, rounded up to fill the cache line
+        expect(calculate_static_size_for(9, sizeof(int)) == 10_u);
+        expect(calculate_static_size_for(11, sizeof(int)) == 26_u);
+      }
+      expect(calculate_static_size_for(1'000'000, sizeof(int)) ==
+             MAX_SIZE_BYTES / sizeof(int));
+      // Sites without a profile fall back to calculate_static_size()
+      expect(profiled_static_size("not.profiled", sizeof(int)) ==
+             calculate_static_size(sizeof(int)));
+    };
+
+    should("keep the peak size of vectors that shrank") = [&stats] {
+      stats.reset();
+      {
+        Counted v;
+        for (int i = 0; i < 17; ++i) {
+          v.push_back(i); // The last push reallocates, to hold 17
+        }
+        v.resize(2);
+      }
+      expect(stats.releases.load() == 1_u);
+      expect(stats.size_histogram[17].load() == 1_u) << "its high-water mark";
+      expect(stats.peak_size.load() == 17_u);
+      expect(stats.peak_capacity.load() == 32_u);
+    };
+
+    should("keep the peak size of vectors that never spilled") = [&stats] {
+      stats.reset();
+      Counted v;
+      v.push_back(1);
+      v.push_back(2);
+      expect(stats.peak_size.load() == 2_u);
+      v.resize(3);
+      expect(stats.peak_size.load() == 3_u);
+      v.pop_back();
+      const int more[] = {4, 5};
+      v.append_range(more);
+      expect(stats.peak_size.load() == 4_u);
+      expect(stats.releases.load() == 0_u) << "v is still alive";
+    };
+
+    should("move the high-water mark along with the values") = [&stats] {
+      stats.reset();
+      {
+        Counted a = {1, 2, 3, 4, 5, 6};
+        a.resize(1);
+        Counted b = std::move(a);
+        Counted c = {7};
+        c.swap(b);
+        c.clear(); // Released at 6, so the destructor has nothing to add
+      }
+      expect(stats.releases.load() == 2_u) << "a was left with nothing";
+      expect(stats.size_histogram[6].load() == 1_u);
+      expect(stats.size_histogram[1].load() == 1_u);
+    };
+
+    should("compiled out by default") = [] {
+#ifndef SMALLVECTOR_INSTRUMENT
+      expect(std::is_same_v<SiteInstrumentation<TestSite>, NoInstrumentation>);
+      expect(sizeof(InstrumentedSmallVector<TestSite, int, 4>) ==
+             sizeof(SmallVector<int, 4>));
+#endif
+      // Only a counting SmallVector has a high-water mark to keep (which a
+      // cache line aligned header has room for in its padding)
+      if constexpr (SMALLVECTOR_ALIGNMENT == 1)
+        expect(sizeof(Counted) > sizeof(SmallVector<int, 4>));
+    };
+  };
+
+  "[constexpr]"_test = [] {
+    should("use a table built at compile time") = [] {
+      expect(SQUARES.is_array());
+      expect(SQUARES.contains(49));
+      expect(SQUARES.count(50) == 0_u);
+      expect(SQUARES.find(100) - SQUARES.begin() == 9_i);
+      SmallVector<int, 16> copy = SQUARES;
+      copy.push_back(256);
+      expect(copy.size() == 16_u);
+      expect(copy.is_array());
+    };
+  };
+
+  "[hardening]"_test = [] {
+    // With the checks off all of this is UB, so there's nothing to test
+#if SMALLVECTOR_HARDENING >= 1
+    should("catch out of range access") = [] {
+      SmallVector<int> v = {1, 2, 3};
+      SmallVector<int> empty;
+      expect(aborts([&] { (void)v[3]; }));
+      expect(aborts([&] { (void)empty.front(); }));
+      expect(aborts([&] { (void)empty.back(); }));
+      expect(aborts([&] { empty.pop_back(); }));
+      expect(aborts([&] { v.insert(v.begin() + 4, 0); }));
+      expect(aborts([&] { v.erase(v.end()); }));
+      expect(aborts([&] { v.erase(v.begin() + 2, v.begin() + 1); }));
+      expect(aborts([&] { v.swap_erase(v.end()); }));
+      // Each of those ran in a child process, so we're untouched
+      expect(v.size() == 3_u && v[2] == 3);
+      expect(!aborts([&] { v.erase(v.begin(), v.end()); }));
+    };
+#endif
+
+#if SMALLVECTOR_HARDENING >= 2
+    should("catch iterators used after their values moved") = [] {
+      SmallVector<int, 4> v = {1, 2, 3, 4};
+      auto it = v.begin();
+      v.push_back(5); // Spills over
+      expect(aborts([&] { (void)*it; }));
+      expect(aborts([&] { v.insert(it, 0); }));
+      it = v.begin() + 1;
+      expect(*it == 2_i);
+      v.reserve(100); // Reallocates
+      expect(aborts([&] { (void)*it; }));
+
+      SmallVector<int, 4>::const_iterator last = v.end() - 1;
+      expect(*last == 5_i);
+      v.resize(2);
+      v.shrink_to_fit(); // Back into the static storage
+      expect(aborts([&] { (void)*last; }));
+
+      SmallVector<int, 4> other = {1, 2};
+      other.swap(v);
+      expect(aborts([&] { v.erase(other.begin()); }));
+      expect(aborts([&] { (void)*v.end(); }));
+      expect(!aborts([&] { (void)*v.begin(); }));
+    };
+#endif
+  };
+
   "[construct/destruct/move/copy]"_test = [] {
     should("construct()") = [] {
       Tracker::reset();
@@ -296,5 +2087,78 @@ int main() {
       expect(Tracker::constructor_count == 5_i);
       expect(Tracker::destructor_count == 5_i);
     };
+
+    should("copy()/move() in vector mode") = [] {
+      SmallVector<int, 4> v = {1, 2, 3, 4, 5, 6};
+      expect(fatal(v.is_vector()));
+      SmallVector<int, 4> copy = v;
+      expect(copy.is_vector());
+      expect(copy.data() != v.data()) << "Copy should own its own heap block";
+      expect(std::equal(copy.begin(), copy.end(), v.begin()));
+
+      const int *block = v.data();
+      SmallVector<int, 4> moved = std::move(v);
+      expect(moved.data() == block) << "Move should steal the heap block";
+      expect(moved.size() == 6_u);
+      expect(v.empty());
+      expect(v.is_array());
+    };
+
+    should("copy()/move() only touch live values") = [] {
+      SmallVector<Tracker, 16> v;
+      v.emplace_back(1);
+      v.emplace_back(2);
+      v.emplace_back(3);
+      Tracker::reset();
+      SmallVector<Tracker, 16> copy = v;
+      expect(Tracker::copy_count == 3_i);
+      Tracker::reset();
+      SmallVector<Tracker, 16> moved = std::move(copy);
+      expect(Tracker::move_count == 3_i);
+      expect(Tracker::copy_count == 0_i);
+      expect(moved[2].a_ == 3_i);
+    };
+
+    should("copy()/move()/swap() with std::string") = [] {
+      using StrVec = SmallVector<std::string, 2>;
+      const std::string long_str(100, 'x'); // Too long for SSO
+      StrVec small = {"a", long_str};
+      StrVec big = {"b", "c", long_str};
+      expect(fatal(small.is_array() && big.is_vector()));
+
+      StrVec small_copy = small;
+      StrVec big_copy = big;
+      expect(small_copy[1] == long_str);
+      expect(big_copy[2] == long_str);
+
+      small_copy = big; // Array = vector
+      expect(small_copy.size() == 3_u);
+      expect(small_copy[0] == "b");
+      big_copy = small; // Vector = array (heap block is reused)
+      expect(big_copy.size() == 2_u);
+      expect(big_copy[1] == long_str);
+
+      StrVec moved = std::move(small_copy);
+      expect(moved.size() == 3_u);
+      expect(moved[2] == long_str);
+      moved = std::move(big_copy);
+      expect(moved.size() == 2_u);
+      expect(moved[0] == "a");
+
+      // Swapping every combination of modes
+      StrVec a = {"1"};
+      StrVec b = {"2", "3"};
+      StrVec c = {"4", "5", "6"};
+      StrVec d = {"7", "8", "9", long_str};
+      a.swap(b); // Array <-> array
+      expect(a.size() == 2_u && a[1] == "3");
+      expect(b.size() == 1_u && b[0] == "1");
+      a.swap(c); // Array <-> vector
+      expect(a.size() == 3_u && a.is_vector() && a[2] == "6");
+      expect(c.size() == 2_u && c.is_array() && c[0] == "2");
+      d.swap(a); // Vector <-> vector
+      expect(d.size() == 3_u && d[0] == "4");
+      expect(a.size() == 4_u && a[3] == long_str);
+    };
   };
 }
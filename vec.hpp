@@ -1,12 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <limits>
-#include <optional>
+#include <memory>
+#include <memory_resource>
+#include <ranges>
+#include <span>
 #include <stdexcept>
-#include <vector>
+#include <type_traits>
+#include <utility>
+
+#include "simd.hpp"
 
 constexpr size_t CACHE_LINE_SIZE_BYTES = 64;
 constexpr size_t MAX_SIZE_BYTES = 10240; // 10 KB
@@ -15,15 +27,79 @@ constexpr size_t FALLBACK_SIZE = 8;
 // of elements HOWEVER, if MAX_SIZE_BYTES is violated, then, we use the minimum
 // amount to satisfy that constraint
 
+// Define SMALLVECTOR_ALIGN_TO_CACHE_LINE to align every SmallVector to
+// CACHE_LINE_SIZE_BYTES. With the default static size, each one then sits in
+// exactly one cache line, but arrays of them can't be packed any tighter than
+// one per line. By default we only use the natural alignment
+#ifdef SMALLVECTOR_ALIGN_TO_CACHE_LINE
+constexpr size_t SMALLVECTOR_ALIGNMENT = CACHE_LINE_SIZE_BYTES;
+#else
+constexpr size_t SMALLVECTOR_ALIGNMENT = 1;
+#endif
+
+// Define SMALLVECTOR_HARDENING to check for misuse at runtime, e.g. on
+// canaries or in tests. Each level includes the ones below it:
+//   0 - no checks, the default, so release builds pay nothing for them
+//   1 - cheap bounds checks, like libc++'s hardening. operator[], front(),
+//       back() and pop_back() check the size, and insert() / erase() check
+//       their positions are ours and in range
+//   2 - debug iterators as well. Instead of plain pointers they remember the
+//       SmallVector they came from and its generation, which goes up every
+//       time the values move to new storage (a spillover, reallocation,
+//       shrink, move or swap). So using one after that is caught, as is
+//       dereferencing one out of range. Every SmallVector gets a 4 byte
+//       generation counter for it
+// A failed check calls SMALLVECTOR_HARDENING_FAILED(message), which prints
+// the message and aborts. Define it first to report it some other way, but
+// it mustn't return
+#ifndef SMALLVECTOR_HARDENING
+#define SMALLVECTOR_HARDENING 0
+#endif
+
+#if SMALLVECTOR_HARDENING > 0
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef SMALLVECTOR_HARDENING_FAILED
+#define SMALLVECTOR_HARDENING_FAILED(message)                                  \
+  (std::fprintf(stderr, "SmallVector: %s\n", message), std::abort())
+#endif
+
+#define SMALLVECTOR_CHECK(condition, message)                                  \
+  do {                                                                         \
+    if (!(condition)) [[unlikely]]                                             \
+      SMALLVECTOR_HARDENING_FAILED(message);                                   \
+  } while (false)
+#else
+#define SMALLVECTOR_CHECK(condition, message) ((void)0)
+#endif
+
+// The bytes a SmallVector uses on top of its static storage: the begin
+// pointer, then the size and capacity, each `size_of_size_t` bytes (and the
+// generation counter with SMALLVECTOR_HARDENING >= 2). Add the size of the
+// allocator if it isn't stateless
+consteval size_t
+header_size_bytes(const size_t size_of_size_t = sizeof(size_t)) {
+  return sizeof(void *) + 2 * size_of_size_t +
+         (SMALLVECTOR_HARDENING >= 2 ? sizeof(uint32_t) : 0);
+}
+
 // Decides at compile time how big to make our static storage
-// If T fits within a cache line, we minimise cache misses by fully utilising
-// the line If T doesn't fit within a cache line, then, we default to
-// FALLBACK_SIZE amount of T If the sizeof(FALLBACK_SIZE * sizeof(T)) >
-// MAX_SIZE_BYTES, then, we use the maximum amount of T that can fit in
-// MAX_SIZE_BYTES, or, 1, whatever is larger.
-consteval size_t calculate_static_size(const size_t size_of_t) {
-  if (size_of_t <= CACHE_LINE_SIZE_BYTES) {
-    return CACHE_LINE_SIZE_BYTES / size_of_t;
+// If T fits within `budget_bytes` (a cache line by default) alongside the
+// `header_bytes`, we use as many T as fit, so the whole SmallVector is no
+// bigger than the budget. If only T itself fits, we have just one. If T
+// doesn't fit within the budget, then, we default to FALLBACK_SIZE amount of T
+// If the sizeof(FALLBACK_SIZE * sizeof(T)) > MAX_SIZE_BYTES, then, we use the
+// maximum amount of T that can fit in MAX_SIZE_BYTES, or, 1, whatever is
+// larger.
+consteval size_t
+calculate_static_size(const size_t size_of_t,
+                      const size_t header_bytes = header_size_bytes(),
+                      const size_t budget_bytes = CACHE_LINE_SIZE_BYTES) {
+  if (size_of_t <= budget_bytes) {
+    const size_t space =
+        (budget_bytes > header_bytes) ? budget_bytes - header_bytes : 0;
+    return (space < size_of_t) ? 1 : space / size_of_t;
   }
   if (FALLBACK_SIZE * size_of_t <= MAX_SIZE_BYTES) {
     return FALLBACK_SIZE;
@@ -33,82 +109,736 @@ consteval size_t calculate_static_size(const size_t size_of_t) {
   }
 }
 
-template <typename T, size_t STATIC_AMOUNT = calculate_static_size(sizeof(T))>
-class SmallVector {
-private:
-  using VecT = std::vector<T>;
+// Like calculate_static_size(), but for when we already know we want room for
+// at least `wanted` values (e.g. from a profiled run, see
+// instrumentation.hpp). Rounds up to use all of the last cache line the
+// SmallVector touches, but never past MAX_SIZE_BYTES of static storage
+consteval size_t
+calculate_static_size_for(const size_t wanted, const size_t size_of_t,
+                          const size_t header_bytes = header_size_bytes()) {
+  const size_t max_amount =
+      (MAX_SIZE_BYTES / size_of_t == 0) ? 1 : MAX_SIZE_BYTES / size_of_t;
+  if (wanted >= max_amount)
+    return max_amount;
+  const size_t wanted_bytes =
+      header_bytes + std::max<size_t>(wanted, 1) * size_of_t;
+  const size_t lines =
+      (wanted_bytes + CACHE_LINE_SIZE_BYTES - 1) / CACHE_LINE_SIZE_BYTES;
+  const size_t amount =
+      (lines * CACHE_LINE_SIZE_BYTES - header_bytes) / size_of_t;
+  return std::min(amount, max_amount);
+}
+
+// True if a T can be moved to a new address by just copying its bytes, without
+// running its move constructor and destructor. Trivially copyable types always
+// can, and other types (e.g. std::unique_ptr like handles) can opt in by
+// specialising this
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+// Tag for constructors which default-initialise their values rather than
+// value-initialise them, so trivially default constructible values (ints,
+// PODs, ...) are left uninitialised instead of being zeroed
+struct default_init_t {
+  explicit default_init_t() = default;
+};
+inline constexpr default_init_t default_init{};
+
+// Growth policies decide how big the next heap block is when we run out of
+// room, both for the first spillover out of the static storage and for every
+// reallocation after it. They're given the current capacity, the capacity we
+// need at least, and sizeof(T)
+
+// Multiplies the capacity by NUM / DEN each time
+template <size_t NUM, size_t DEN> struct GrowByFactor {
+  static_assert(NUM > DEN, "Growth factor must be more than 1");
+
+  static constexpr size_t next_capacity(size_t capacity, size_t min_capacity,
+                                        size_t) noexcept {
+    return std::max(min_capacity, capacity * NUM / DEN);
+  }
+};
+
+using GrowBy2 = GrowByFactor<2, 1>;
+using GrowBy1_5 = GrowByFactor<3, 2>;
+
+// Doubles the capacity, then rounds the size of the heap block in bytes up to
+// a power of two, so it lines up with the allocator's size classes. Blocks
+// too big to be rounded up without overflowing are left as they are
+struct GrowToPowerOfTwo {
+  static constexpr size_t next_capacity(size_t capacity, size_t min_capacity,
+                                        size_t size_of_t) noexcept {
+    const size_t max_capacity = SIZE_MAX / size_of_t;
+    const size_t doubled =
+        capacity > max_capacity / 2 ? max_capacity : capacity * 2;
+    const size_t wanted =
+        std::min(std::max(min_capacity, doubled), max_capacity);
+    const size_t bytes = wanted * size_of_t;
+    if (bytes > SIZE_MAX / 2 + 1)
+      return wanted;
+    return std::bit_ceil(bytes) / size_of_t;
+  }
+};
+
+// Instrumentation policies are told about the events below, so they can count
+// how often (and how far) SmallVectors spill over. NoInstrumentation is the
+// default and does nothing, so it all compiles away. See instrumentation.hpp
+// for one that keeps counts and a histogram of sizes
+struct NoInstrumentation {
+  // We spilled over out of the static storage into a heap block of
+  // `capacity`, to hold `size` values
+  static constexpr void on_spillover(size_t, size_t) noexcept {}
+  // We moved from one heap block into another of `capacity`, to hold `size`
+  // values
+  static constexpr void on_reallocation(size_t, size_t) noexcept {}
+  // `count` values were moved to a new address
+  static constexpr void on_relocate(size_t) noexcept {}
+
+  // The rest are called on the SmallVector's own Instrumentation, which it
+  // keeps (taking no space when it's empty, like this one) so they can follow
+  // its high-water mark. It moves and swaps along with the values
+
+  // Our size went up to `size`
+  constexpr void on_size(size_t) noexcept {}
+  // We were cleared or destroyed, holding `size` values (which can be 0, e.g.
+  // when we were emptied first)
+  constexpr void on_release(size_t) noexcept {}
+};
+
+// A SmallVector's static storage. When it overflows, we move into a heap
+// block. It's a union so the values only get constructed as we need them,
+// while still being real T objects that constant evaluation can see
+template <typename T, size_t N> union SmallVectorStorage {
+  constexpr SmallVectorStorage() noexcept {}
+  constexpr ~SmallVectorStorage() {}
+  T values[N];
+};
+
+// Everything about a SmallVector except its static storage, like LLVM's
+// SmallVectorImpl. Every SmallVector<T, N> is one, whatever its N, so code
+// which doesn't care how much is kept inline can take a SmallVectorImpl<T> &
+// and be compiled just once, instead of once per N. Nearly all of the code
+// lives here for the same reason, leaving SmallVector with just the parts
+// that have to know N: constructing, destructing, moving, copying, swapping
+// and shrinking back into the static storage.
+//
+// SizeT is the type used to store the size and capacity. Using uint32_t
+// (or uint16_t) instead of size_t shrinks the header, in exchange for a lower
+// max_size()
+template <typename T, typename SizeT = size_t,
+          typename Allocator = std::allocator<T>,
+          typename GrowthPolicy = GrowBy2,
+          typename Instrumentation = NoInstrumentation>
+class SmallVectorImpl {
+protected:
+  // Laid out just like a SmallVector (with any N) over `Base`, but never
+  // made, only there for inline_offset() to measure
+  template <typename Base> struct SmallVectorInlineLayout : Base {
+    SmallVectorStorage<T, 1> storage;
+  };
+
+  using AllocTraits = std::allocator_traits<Allocator>;
+  static_assert(std::is_same_v<typename AllocTraits::value_type, T>,
+                "Allocator::value_type must be T");
+  static_assert(std::is_unsigned_v<SizeT>, "SizeT must be unsigned");
+
+  // begin_ points at the static storage while we are using it, and at a heap
+  // block once we have spilled over, so element access never has to branch on
+  // which mode we are in
+  alignas(SMALLVECTOR_ALIGNMENT) alignas(T *) T *begin_;
+  SizeT size_;
+  SizeT capacity_;
+  // Only used for the heap block, takes no space if it's stateless
+  [[no_unique_address]] Allocator alloc_;
+  [[no_unique_address]] Instrumentation instrumentation_;
+#if SMALLVECTOR_HARDENING >= 2
+  // Goes up whenever begin_ changes, so our iterators can tell they're stale
+  uint32_t generation_ = 0;
+#endif
+
+  // A SmallVector's static storage is its only member, and is aligned to T
+  // whatever N is, so it's always this far from `this`. The compiler works
+  // that out from SmallVectorInlineLayout, tail padding and all, so it's
+  // right for whatever ABI we're built for (and SmallVector checks it). Like
+  // LLVM we need offsetof() on a type that isn't standard layout, which every
+  // compiler we know of supports, but GCC and Clang warn about
+  static consteval size_t inline_offset() {
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+#endif
+    return offsetof(SmallVectorInlineLayout<SmallVectorImpl>, storage);
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+  }
+
+  // Finding the static storage that way takes a reinterpret_cast, which
+  // constant evaluation doesn't allow. So there, being on the heap is marked
+  // by the top bit of capacity_ instead. Heap blocks can't outlive constant
+  // evaluation, so the bit is never set at runtime
+  static constexpr SizeT HEAP_FLAG =
+      SizeT(1) << (std::numeric_limits<SizeT>::digits - 1);
 
-  // When our arr_ overflows, we move into the internal vec_
-  alignas(CACHE_LINE_SIZE_BYTES) std::byte arr_[STATIC_AMOUNT * sizeof(T)];
-  std::optional<VecT> vec_;
-  size_t size_;
+  const T *inline_storage() const noexcept {
+    return reinterpret_cast<const T *>(
+        reinterpret_cast<const std::byte *>(this) + inline_offset());
+  }
+
+  // Whether our values can be moved to a new place without anything throwing.
+  // When they can't, growing copies them instead (like std::move_if_noexcept)
+  // so the originals are still there if a copy throws
+  static constexpr bool NOTHROW_RELOCATE =
+      is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>;
+
+#if SMALLVECTOR_HARDENING >= 2
+  // Our iterators with SMALLVECTOR_HARDENING >= 2. They're checked when
+  // they're dereferenced, or given back to us to insert or erase at, but the
+  // arithmetic is as cheap as a pointer's
+  template <bool CONST> class CheckedIterator {
+  private:
+    friend SmallVectorImpl;
+    template <bool> friend class CheckedIterator;
+    using Value = std::conditional_t<CONST, const T, T>;
+
+    Value *ptr_ = nullptr;
+    const SmallVectorImpl *owner_ = nullptr;
+    uint32_t generation_ = 0;
+
+    constexpr CheckedIterator(Value *ptr,
+                              const SmallVectorImpl *owner) noexcept
+        : ptr_(ptr), owner_(owner), generation_(owner->generation_) {}
+
+    constexpr void check_valid() const noexcept {
+      SMALLVECTOR_CHECK(owner_ != nullptr &&
+                            generation_ == owner_->generation_,
+                        "Iterator used after its values moved");
+    }
+
+    constexpr void check_dereferenceable() const noexcept {
+      check_valid();
+      SMALLVECTOR_CHECK(ptr_ >= owner_->begin_ &&
+                            ptr_ < owner_->begin_ + owner_->size_,
+                        "Iterator dereferenced out of range");
+    }
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = Value *;
+    using reference = Value &;
+
+    constexpr CheckedIterator() noexcept = default;
+
+    // iterator converts to const_iterator
+    template <bool OTHER_CONST>
+      requires(CONST && !OTHER_CONST)
+    constexpr CheckedIterator(
+        const CheckedIterator<OTHER_CONST> &other) noexcept
+        : ptr_(other.ptr_), owner_(other.owner_),
+          generation_(other.generation_) {}
+
+    constexpr reference operator*() const noexcept {
+      check_dereferenceable();
+      return *ptr_;
+    }
+    constexpr pointer operator->() const noexcept {
+      check_dereferenceable();
+      return ptr_;
+    }
+    constexpr reference operator[](difference_type n) const noexcept {
+      return *(*this + n);
+    }
+
+    constexpr CheckedIterator &operator++() noexcept {
+      ++ptr_;
+      return *this;
+    }
+    constexpr CheckedIterator operator++(int) noexcept {
+      CheckedIterator old = *this;
+      ++ptr_;
+      return old;
+    }
+    constexpr CheckedIterator &operator--() noexcept {
+      --ptr_;
+      return *this;
+    }
+    constexpr CheckedIterator operator--(int) noexcept {
+      CheckedIterator old = *this;
+      --ptr_;
+      return old;
+    }
+    constexpr CheckedIterator &operator+=(difference_type n) noexcept {
+      ptr_ += n;
+      return *this;
+    }
+    constexpr CheckedIterator &operator-=(difference_type n) noexcept {
+      ptr_ -= n;
+      return *this;
+    }
 
-  // Spills over the current array values into a vector, with the ability to
-  // reserve more than we need with `extra`
-  constexpr void spillover(size_t capacity) {
-    assert(is_array()); // Should be uninitialised
-    assert(capacity >=
-           STATIC_AMOUNT); // Should be more than we are moving or same
-    vec_ = std::make_optional<VecT>();
-    vec_->reserve(capacity);
-    for (size_t i = 0; i < size_ && i < STATIC_AMOUNT; ++i) {
-      vec_->push_back(std::move(get_arr_element(i)));
-      get_arr_element_ptr(i)->~T();
+    friend constexpr CheckedIterator operator+(CheckedIterator it,
+                                               difference_type n) noexcept {
+      return it += n;
+    }
+    friend constexpr CheckedIterator operator+(difference_type n,
+                                               CheckedIterator it) noexcept {
+      return it += n;
+    }
+    friend constexpr CheckedIterator operator-(CheckedIterator it,
+                                               difference_type n) noexcept {
+      return it -= n;
+    }
+    friend constexpr difference_type
+    operator-(const CheckedIterator &lhs, const CheckedIterator &rhs) noexcept {
+      return lhs.ptr_ - rhs.ptr_;
+    }
+
+    friend constexpr bool operator==(const CheckedIterator &lhs,
+                                     const CheckedIterator &rhs) noexcept {
+      return lhs.ptr_ == rhs.ptr_;
+    }
+    friend constexpr std::strong_ordering
+    operator<=>(const CheckedIterator &lhs,
+                const CheckedIterator &rhs) noexcept {
+      return lhs.ptr_ <=> rhs.ptr_;
     }
+  };
+#endif
+
+  // Points us at `block`, which has room for `capacity` values and is a heap
+  // block if `heap` (else the static storage). That invalidates every
+  // iterator, which SMALLVECTOR_HARDENING >= 2 keeps track of
+  constexpr void set_storage(T *block, size_t capacity, bool heap) noexcept {
+    begin_ = block;
+    capacity_ = static_cast<SizeT>(capacity);
+    if (std::is_constant_evaluated() && heap)
+      capacity_ |= HEAP_FLAG;
+#if SMALLVECTOR_HARDENING >= 2
+    ++generation_;
+#endif
   }
 
-  // Just two nice helper functions
-  constexpr T *get_arr_element_ptr(size_t i) noexcept {
-    return reinterpret_cast<T *>(arr_) + i;
+  // Moves the current values into a new heap block that can hold `capacity`
+  // values, freeing the old block if we were already on the heap. `size` is
+  // how many values the caller is about to have, for the instrumentation
+  constexpr void spillover(size_t capacity, size_t size) {
+    assert(capacity >= size_); // Should be more than we are moving or same
+    assert(capacity <= max_size());
+    move_to_block(allocate_block(capacity, size), capacity, size_, 0);
+  }
+
+  // Where to take values from when moving them to a new place can throw
+  // (!NOTHROW_RELOCATE). They're copied if they can be, else moved, but
+  // either way the originals are only destructed once they've all made it
+  static constexpr auto transfer_from(T *src) noexcept {
+    if constexpr (std::is_copy_constructible_v<T>) {
+      return src;
+    } else {
+      return std::make_move_iterator(src);
+    }
+  }
+
+  // Moves the current values into the new heap `block`, leaving a gap of
+  // `gap` uninitialised values at `idx`, and frees the old block. If T's move
+  // can throw the values are copied over (or, with no copy, moved without
+  // destructing any until they're all over), and if one throws, `block` is
+  // given back and we still have all of our values
+  constexpr void move_to_block(T *block, size_t capacity, size_t idx,
+                               size_t gap) {
+    if constexpr (!NOTHROW_RELOCATE) {
+      try {
+        copy_values(transfer_from(begin_), idx, block);
+        try {
+          copy_values(transfer_from(begin_ + idx), size_ - idx,
+                      block + idx + gap);
+        } catch (...) {
+          std::destroy_n(block, idx);
+          throw;
+        }
+      } catch (...) {
+        AllocTraits::deallocate(alloc_, block, capacity);
+        throw;
+      }
+      std::destroy(begin_, begin_ + size_);
+    } else {
+      relocate(begin_, idx, block);
+      relocate(begin_ + idx, size_ - idx, block + idx + gap);
+    }
+    free_heap();
+    set_storage(block, capacity, true);
+  }
+
+  // Makes room for at least `min_capacity` values, growing by GrowthPolicy.
+  // The first spill counts as growing from the static size, so it already
+  // reserves room for more than the one value we're adding
+  constexpr void grow(size_t min_capacity) {
+    spillover(next_capacity(min_capacity), min_capacity);
+  }
+
+  // The capacity GrowthPolicy wants when we need room for `min_capacity`
+  constexpr size_t next_capacity(size_t min_capacity) const {
+    if (min_capacity > max_size())
+      throw std::length_error("SmallVector grown above maximum size");
+    return std::min(
+        GrowthPolicy::next_capacity(capacity(), min_capacity, sizeof(T)),
+        max_size());
+  }
+
+  // Shuffles the values from `idx` onwards up by `count`, growing if needed,
+  // and returns the start of the (uninitialised) gap. When we have to grow
+  // the values go straight to either side of the gap in the new heap block,
+  // rather than being moved twice. size_ is left for the caller to update
+  // once the gap is filled
+  constexpr T *open_gap(size_t idx, size_t count) {
+    if (size_ + count > capacity()) {
+      const size_t capacity = next_capacity(size_ + count);
+      move_to_block(allocate_block(capacity, size_ + count), capacity, idx,
+                    count);
+    } else if constexpr (NOTHROW_RELOCATE) {
+      relocate_overlapping(begin_ + idx, size_ - idx, begin_ + idx + count);
+    } else {
+      shift_up(idx, count);
+    }
+    return begin_ + idx;
+  }
+
+  // Undoes open_gap(idx, count), for when filling the gap threw
+  constexpr void close_gap(size_t idx, size_t count) noexcept {
+    if constexpr (NOTHROW_RELOCATE) {
+      relocate_overlapping(begin_ + idx + count, size_ - idx, begin_ + idx);
+    } else {
+      // Moving them back down could throw as well, so drop them instead
+      std::destroy_n(begin_ + idx + count, size_ - idx);
+      size_ = static_cast<SizeT>(idx);
+    }
+  }
+
+  // Opens a gap of `count` values at `idx` and fills it with `fill(dst)`. If
+  // that throws, the gap is closed again before passing the exception on
+  template <typename Fill>
+  constexpr T *fill_gap(size_t idx, size_t count, Fill fill) {
+    T *dst = open_gap(idx, count);
+    try {
+      fill(dst);
+    } catch (...) {
+      close_gap(idx, count);
+      throw;
+    }
+    size_ += static_cast<SizeT>(count);
+    note_size();
+    return dst;
+  }
+
+  // open_gap() within our own storage when T's move can throw. If one does,
+  // the values already moved up are destructed and we are cut down to the
+  // ones before them, so we at least stay valid (the basic guarantee)
+  constexpr void shift_up(size_t idx, size_t count) {
+    T *src = begin_ + idx;
+    const size_t moving = size_ - idx;
+    for (size_t i = moving; i > 0; --i) {
+      try {
+        std::construct_at(src + i - 1 + count, std::move(src[i - 1]));
+      } catch (...) {
+        std::destroy(src + i + count, src + moving + count);
+        size_ = static_cast<SizeT>(idx + i);
+        throw;
+      }
+      std::destroy_at(src + i - 1);
+    }
+  }
+
+  // Adds the `count` values starting at `first` to the back, growing at most
+  // once. Huge runs of trivially copyable values are copied with
+  // simd::stream_copy(), so e.g. merging big vectors doesn't flush the cache
+  template <typename It> constexpr void append_n(It first, size_t count) {
+#if SMALLVECTOR_HARDENING >= 2
+    if constexpr (std::is_same_v<It, iterator> ||
+                  std::is_same_v<It, const_iterator>) {
+      // These may be our own iterators, which growing makes stale, so work
+      // with the pointers instead
+      if (count != 0)
+        first.check_dereferenceable();
+      append_n(static_cast<const T *>(first.ptr_), count);
+      return;
+    }
+#endif
+    if (size_ + count > capacity()) {
+      if constexpr (std::contiguous_iterator<It> &&
+                    std::is_same_v<std::iter_value_t<It>, T>) {
+        // They may be our own values (v.append(v)), which growing moves, so
+        // find them again in the new block
+        if (count != 0 && is_own(std::to_address(first))) {
+          const size_t offset =
+              static_cast<size_t>(std::to_address(first) - begin_);
+          grow(size_ + count);
+          append_n(begin_ + offset, count);
+          return;
+        }
+      }
+      grow(size_ + count);
+    }
+    if constexpr (std::is_trivially_copyable_v<T> &&
+                  std::contiguous_iterator<It> &&
+                  std::is_same_v<std::iter_value_t<It>, T>) {
+      if (!std::is_constant_evaluated() &&
+          count >= simd::STREAM_COPY_BYTES / sizeof(T)) {
+        simd::stream_copy(static_cast<void *>(begin_ + size_),
+                          static_cast<const void *>(std::to_address(first)),
+                          count * sizeof(T));
+        size_ += static_cast<SizeT>(count);
+        note_size();
+        return;
+      }
+    }
+    copy_values(first, count, begin_ + size_);
+    size_ += static_cast<SizeT>(count);
+    note_size();
+  }
+
+  // Tells the Instrumentation our size went up
+  constexpr void note_size() noexcept {
+    if (!std::is_constant_evaluated())
+      instrumentation_.on_size(size_);
+  }
+
+  // Gets a new heap block for `capacity` values, which we are about to move
+  // into to hold `size` values
+  constexpr T *allocate_block(size_t capacity, size_t size) {
+    if (!std::is_constant_evaluated()) {
+      if (is_array()) {
+        Instrumentation::on_spillover(capacity, size);
+      } else {
+        Instrumentation::on_reallocation(capacity, size);
+      }
+    }
+    // capacity_'s top bit is taken in constant evaluation, see HEAP_FLAG
+    if (std::is_constant_evaluated() && capacity >= HEAP_FLAG)
+      throw std::length_error("SmallVector grown above maximum size");
+    return AllocTraits::allocate(alloc_, capacity);
+  }
+
+  // Moves `count` values from `src` into the uninitialised `dst`, destructing
+  // the values left behind. The two ranges must not overlap
+  static constexpr void relocate(T *src, size_t count, T *dst) {
+    if (!std::is_constant_evaluated()) {
+      Instrumentation::on_relocate(count);
+      if constexpr (is_trivially_relocatable_v<T>) {
+        if (count != 0)
+          std::memcpy(static_cast<void *>(dst),
+                      static_cast<const void *>(src), count * sizeof(T));
+        return;
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      std::construct_at(dst + i, std::move(src[i]));
+      std::destroy_at(src + i);
+    }
+  }
+
+  // Same as relocate(), but the two ranges are allowed to overlap, as they do
+  // when we shuffle values up or down within our own storage
+  static constexpr void relocate_overlapping(T *src, size_t count, T *dst) {
+    if (!std::is_constant_evaluated()) {
+      Instrumentation::on_relocate(count);
+      if constexpr (is_trivially_relocatable_v<T>) {
+        if (count != 0)
+          std::memmove(static_cast<void *>(dst),
+                       static_cast<const void *>(src), count * sizeof(T));
+        return;
+      }
+    }
+    if (dst < src) {
+      // Moving down, so go front to back to not trample anything
+      for (size_t i = 0; i < count; ++i) {
+        std::construct_at(dst + i, std::move(src[i]));
+        std::destroy_at(src + i);
+      }
+    } else {
+      // Moving up, so go back to front
+      for (size_t i = count; i > 0; --i) {
+        std::construct_at(dst + i - 1, std::move(src[i - 1]));
+        std::destroy_at(src + i - 1);
+      }
+    }
+  }
+
+  // Gives the heap block back, if we have one. Doesn't destruct anything, so
+  // the caller must have already destructed the values in it
+  constexpr void free_heap() noexcept {
+    if (is_vector())
+      AllocTraits::deallocate(alloc_, begin_, capacity());
+  }
+
+  // Overwrites our values with the `count` values starting at `first`. Values
+  // we already have are assigned to rather than destructed and constructed
+  // again, and our heap block is reused if it's big enough
+  template <typename It> constexpr void assign_from(It first, size_t count) {
+    if (count > capacity()) {
+      // Everything we have gets overwritten, so don't bother moving it into
+      // the new heap block
+      clear();
+      reserve(count);
+    }
+    const size_t common = std::min<size_t>(size_, count);
+    std::copy_n(first, common, begin_);
+    if (count > size_) {
+      copy_values(std::next(first, common), count - common, begin_ + common);
+    } else {
+      std::destroy(begin_ + count, begin_ + size_);
+    }
+    size_ = static_cast<SizeT>(count);
+    note_size();
   }
-  constexpr T &get_arr_element(size_t i) noexcept {
-    return *get_arr_element_ptr(i);
+
+  // Copies `count` values from `src` into the uninitialised `dst`. For
+  // trivially copyable types in contiguous memory that's a single memcpy of
+  // just those values
+  template <typename It>
+  static constexpr void copy_values(It src, size_t count, T *dst) {
+    if (std::is_constant_evaluated()) {
+      for (size_t i = 0; i < count; ++i, ++src) {
+        std::construct_at(dst + i, *src);
+      }
+    } else if constexpr (std::is_trivially_copyable_v<T> &&
+                         std::contiguous_iterator<It> &&
+                         std::is_same_v<std::iter_value_t<It>, T>) {
+      if (count != 0)
+        std::memcpy(static_cast<void *>(dst),
+                    static_cast<const void *>(std::to_address(src)),
+                    count * sizeof(T));
+    } else {
+      std::uninitialized_copy_n(src, count, dst);
+    }
+  }
+
+  // The std::uninitialized_* algorithms aren't constexpr (until C++26), so
+  // these do the same one std::construct_at at a time in constant evaluation
+  static constexpr void fill_values(T *dst, size_t count, const T &value) {
+    if (std::is_constant_evaluated()) {
+      for (size_t i = 0; i < count; ++i) {
+        std::construct_at(dst + i, value);
+      }
+    } else {
+      std::uninitialized_fill_n(dst, count, value);
+    }
   }
-  constexpr const T *get_arr_element_ptr(size_t i) const noexcept {
-    return reinterpret_cast<const T *>(arr_) + i;
+
+  static constexpr void value_construct_values(T *dst, size_t count) {
+    if (std::is_constant_evaluated()) {
+      for (size_t i = 0; i < count; ++i) {
+        std::construct_at(dst + i);
+      }
+    } else {
+      std::uninitialized_value_construct_n(dst, count);
+    }
   }
-  constexpr const T &get_arr_element(size_t i) const noexcept {
-    return *get_arr_element_ptr(i);
+
+  // Shrinks down to, or grows up to, `count` values. When growing,
+  // `construct(dst, n)` is called once to construct the `n` new values at
+  // `dst`
+  template <typename Construct>
+  constexpr void resize_with(size_t count, Construct construct) {
+    if (count > max_size())
+      throw std::length_error("Requested resize above maximum size");
+
+    if (count < size_) {
+      std::destroy(begin_ + count, begin_ + size_);
+    } else if (count > size_) {
+      reserve(count);
+      construct(begin_ + size_, count - size_);
+    }
+    size_ = static_cast<SizeT>(count);
+    note_size();
+  }
+
+  // Whether `ptr` points at one of our values. Comparing pointers into
+  // different objects isn't allowed in constant evaluation, so there we check
+  // them one at a time
+  constexpr bool is_own(const T *ptr) const noexcept {
+    if (std::is_constant_evaluated()) {
+      for (size_t i = 0; i < size_; ++i) {
+        if (ptr == begin_ + i)
+          return true;
+      }
+      return false;
+    }
+    return std::less_equal<const T *>()(begin_, ptr) &&
+           std::less<const T *>()(ptr, begin_ + size_);
+  }
+
+  // Index of the first value equal to `value`, or size_ if there isn't one
+  constexpr size_t find_index(const T &value) const {
+    if constexpr (simd::Searchable<T>) {
+      if (!std::is_constant_evaluated())
+        return simd::find(begin_, size_, value);
+    }
+    return static_cast<size_t>(std::find(begin_, begin_ + size_, value) -
+                               begin_);
   }
 
 public:
   using value_type = T;
   using reference = T &;
   using const_reference = const T &;
+#if SMALLVECTOR_HARDENING >= 2
+  using iterator = CheckedIterator<false>;
+  using const_iterator = CheckedIterator<true>;
+#else
   using iterator = T *;
   using const_iterator = const T *;
+#endif
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-  constexpr SmallVector() : size_(0) {};
+  using allocator_type = Allocator;
 
-  constexpr explicit SmallVector(size_t count) : size_(0) {
-    reserve(count);
-    // Could be in either array/vector mode
-    for (size_t i = 0; i < count; ++i) {
-      emplace_back();
-    }
+protected:
+  // Internally we work with plain pointers, which these turn into iterators
+  constexpr iterator to_iterator(T *ptr) noexcept {
+#if SMALLVECTOR_HARDENING >= 2
+    return iterator(ptr, this);
+#else
+    return ptr;
+#endif
   }
-
-  constexpr SmallVector(size_t count, const T &value) : size_(0) {
-    reserve(count);
-    for (size_t i = 0; i < count; ++i) {
-      push_back(value);
-    }
+  constexpr const_iterator to_iterator(const T *ptr) const noexcept {
+#if SMALLVECTOR_HARDENING >= 2
+    return const_iterator(ptr, this);
+#else
+    return ptr;
+#endif
   }
 
-  constexpr SmallVector(std::initializer_list<T> init) : size_(0) {
-    reserve(init.size());
-    std::copy(init.begin(), init.end(), std::back_inserter(*this));
+  // The index `pos` is at, which may be size_ for end()
+  constexpr size_t index_of(const_iterator pos) const noexcept {
+#if SMALLVECTOR_HARDENING >= 2
+    SMALLVECTOR_CHECK(pos.owner_ == this, "Iterator from another SmallVector");
+    pos.check_valid();
+    const auto idx = static_cast<size_t>(pos.ptr_ - begin_);
+#else
+    const auto idx = static_cast<size_t>(pos - begin_);
+#endif
+    SMALLVECTOR_CHECK(idx <= size_, "Iterator out of range");
+    return idx;
   }
 
-  constexpr ~SmallVector() { clear(); };
+  // Only SmallVector makes these, pointing us at its static storage once
+  // that's constructed
+  constexpr explicit SmallVectorImpl(const Allocator &alloc)
+      : begin_(nullptr), size_(0), capacity_(0), alloc_(alloc) {}
 
-  constexpr SmallVector(const SmallVector &other) = default;
-  constexpr SmallVector(SmallVector &&other) = default;
+  // Not virtual, as we're never destroyed through a SmallVectorImpl *
+  constexpr ~SmallVectorImpl() = default;
 
-  constexpr SmallVector &operator=(const SmallVector &other) = default;
-  constexpr SmallVector &operator=(SmallVector &&other) = default;
+public:
+  // Copying needs to know N, so it's only done through SmallVector
+  SmallVectorImpl(const SmallVectorImpl &) = delete;
+  SmallVectorImpl &operator=(const SmallVectorImpl &) = delete;
 
   // ----- ELEMENT ACCESS -----
 
@@ -129,10 +859,12 @@ public:
   }
 
   constexpr T &operator[](size_t i) {
-    return is_vector() ? (*vec_)[i] : get_arr_element(i);
+    SMALLVECTOR_CHECK(i < size_, "Out of range access");
+    return begin_[i];
   }
   constexpr const T &operator[](size_t i) const {
-    return is_vector() ? (*vec_)[i] : get_arr_element(i);
+    SMALLVECTOR_CHECK(i < size_, "Out of range access");
+    return begin_[i];
   }
 
   constexpr T &front() { return (*this)[0]; }
@@ -141,34 +873,22 @@ public:
   constexpr T &back() { return (*this)[size_ - 1]; }
   constexpr const T &back() const { return (*this)[size_ - 1]; }
 
-  constexpr T *data() noexcept {
-    return is_vector() ? &(*vec_)[0] : get_arr_element_ptr(0);
-  }
-  constexpr const T *data() const noexcept {
-    return is_vector() ? &(*vec_)[0] : get_arr_element_ptr(0);
-  }
+  constexpr T *data() noexcept { return begin_; }
+  constexpr const T *data() const noexcept { return begin_; }
 
   // ----- ITERATORS -----
 
-  constexpr iterator begin() noexcept {
-    return is_vector() ? &(*vec_)[0] : get_arr_element_ptr(0);
-  }
+  constexpr iterator begin() noexcept { return to_iterator(begin_); }
   constexpr const_iterator begin() const noexcept {
-    return is_vector() ? &(*vec_)[0] : get_arr_element_ptr(0);
-  }
-  constexpr const_iterator cbegin() const noexcept {
-    return is_vector() ? &(*vec_)[0] : get_arr_element_ptr(0);
+    return to_iterator(begin_);
   }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
 
-  constexpr iterator end() noexcept {
-    return is_vector() ? &(*vec_)[size_] : get_arr_element_ptr(size_);
-  }
+  constexpr iterator end() noexcept { return to_iterator(begin_ + size_); }
   constexpr const_iterator end() const noexcept {
-    return is_vector() ? &(*vec_)[size_] : get_arr_element_ptr(size_);
-  }
-  constexpr const_iterator cend() const noexcept {
-    return is_vector() ? &(*vec_)[size_] : get_arr_element_ptr(size_);
+    return to_iterator(begin_ + size_);
   }
+  constexpr const_iterator cend() const noexcept { return end(); }
 
   constexpr reverse_iterator rbegin() noexcept {
     return reverse_iterator(end());
@@ -198,93 +918,50 @@ public:
   // Returns the current amount of stored values T in the SmallVector
   constexpr size_t size() const { return size_; }
 
-  // The maximum size is limited by the vector, not the static storage
+  // The maximum size is limited by SizeT (and how many T fit in memory), not
+  // the static storage
   constexpr static size_t max_size() noexcept {
-    return std::numeric_limits<T>::max();
+    return std::min<size_t>(std::numeric_limits<SizeT>::max(),
+                            std::numeric_limits<size_t>::max() / sizeof(T));
   }
 
-  // Reserves the requested amount if the size is > the current capacity (sum of
-  // stack storage & vector's capacity). Has the side effect of initialising the
-  // internal vector and reserving size if size > STATIC_SIZE
+  // Reserves the requested amount if the size is > the current capacity.
+  // Has the side effect of spilling over into a heap block if size >
+  // STATIC_SIZE
   constexpr void reserve(size_t size) {
-    // If we want the amount statically stored, then, do nothing!
-    if (size <= STATIC_AMOUNT) {
+    // If we already have room (including in the static storage), do nothing!
+    if (size <= capacity())
       return;
-    } else {
-      if (is_array()) {
-        spillover(size);
-      } else {
-        vec_->reserve(size);
-      }
-    }
+    if (size > max_size())
+      throw std::length_error("Requested reserve above maximum size");
+    spillover(size, size_);
   }
 
   // Returns the capacity of the SmallVector
-  // If the internal vector hasn't been allocated (no spillover), returns the
-  // size of the stack allocated array, and if it has, then the vector's
-  // capacity
+  // If we haven't spilled over, returns the size of the static storage, and
+  // if we have, then the capacity of the heap block
   constexpr size_t capacity() const noexcept {
-    if (is_array()) {
-      return STATIC_AMOUNT;
-    } else {
-      return vec_->capacity();
-    }
-  }
-
-  // Has no side effects if using the internal static storage, otherwise calls
-  // the vector's `shrink_to_fit()`
-  constexpr void shrink_to_fit() {
-    if (is_vector())
-      vec_->shrink_to_fit();
+    if (std::is_constant_evaluated())
+      return capacity_ & ~HEAP_FLAG;
+    return capacity_;
   }
 
   // ----- MODIFIERS -----
 
-  // Clears the internal static storage, or the vector, whatever's in use. If we
-  // are in vector mode, this resets the vector back to an array
+  // Clears the internal static storage, or the heap block, whatever's in use.
+  // Like std::vector, the capacity is kept, so if we are in vector mode we stay
+  // there. Use release() to give the heap block back as well
   constexpr void clear() {
-    if (is_vector()) {
-      // All the static elements have been moved to the vector, and already
-      // destructed by `spillover()`, so all we need to do is clear the vec
-      vec_->clear();
-      // Wipes the std::optional back to being empty
-      vec_.reset();
-    } else {
-      for (size_t i = size_; i > 0; --i) {
-        get_arr_element_ptr(i - 1)->~T();
-      }
-    }
+    if (!std::is_constant_evaluated())
+      instrumentation_.on_release(size_);
+    std::destroy(begin_, begin_ + size_);
     size_ = 0;
   }
 
-  // Inserts `value` at `pos`
-  // If a constructor / move throws, then, UB
-  // TODO: Use a temporary buff or something to leave a consistent
-  // state if an exception occurs, guarantee no change to our class
+  // Inserts `value` at `pos`. Like all the inserts, if anything throws we are
+  // left as we were, as long as T's move doesn't throw
   constexpr iterator insert(const_iterator pos, T &&value) {
-    const size_t idx = static_cast<size_t>(pos - cbegin());
-    size_++;
-    if (is_array() && size_ <= STATIC_AMOUNT) {
-      for (size_t i = size_ - 1; i > idx; --i) {
-        T *src = get_arr_element_ptr(i - 1);
-        T *dst = get_arr_element_ptr(i);
-        new (dst) T(std::move(*src));
-        src->~T();
-      }
-
-      T *dst = get_arr_element_ptr(idx);
-      new (dst) T(std::forward<T>(value));
-      return dst;
-    }
-
-    // If below is true, then, size_ must be > STATIC_AMOUNT
-    if (is_array())
-      spillover(size_);
-
-    // If we spillover, we now have a vector, or we already had a vector
-    auto it = vec_->insert(vec_->begin() + idx, std::forward<T>(value));
-    // Bit of a nasty way of converting the vector's iterator to ours
-    return &(*it);
+    return emplace(pos, std::move(value));
   }
 
   // Inserts `value` at `pos`
@@ -292,249 +969,660 @@ public:
     return insert(pos, T(value));
   }
 
-  // Constructs a new value in-place at `pos` of the SmallVector
-  template <typename... Args>
-  constexpr iterator emplace(const_iterator pos, Args &&...args) {
-    const size_t idx = static_cast<size_t>(pos - cbegin());
-    size_++;
-    if (is_array() && size_ <= STATIC_AMOUNT) {
-      for (size_t i = size_ - 1; i > idx; --i) {
-        T *src = get_arr_element_ptr(i - 1);
-        T *dst = get_arr_element_ptr(i);
-        new (dst) T(std::move(*src));
-        src->~T();
-      }
+  // Inserts `count` copies of `value` at `pos`
+  constexpr iterator insert(const_iterator pos, size_t count, const T &value) {
+    const size_t idx = index_of(pos);
+    if (count == 0)
+      return to_iterator(begin_ + idx);
+    // `value` may be one of our own values, which open_gap() could move
+    const T copy(value);
+    return to_iterator(fill_gap(
+        idx, count, [&](T *dst) { fill_values(dst, count, copy); }));
+  }
 
-      T *dst = get_arr_element_ptr(idx);
-      new (dst) T(std::forward<Args>(args)...);
-      return dst;
+  // Inserts the values from `first` to `last` (which must not be our own) at
+  // `pos`. With forward iterators we count them first, so we grow at most
+  // once and shuffle the tail up just once
+  template <std::input_iterator It>
+  constexpr iterator insert(const_iterator pos, It first, It last) {
+    const size_t idx = index_of(pos);
+    if constexpr (std::forward_iterator<It>) {
+      const size_t count = static_cast<size_t>(std::distance(first, last));
+      return to_iterator(fill_gap(
+          idx, count, [&](T *dst) { copy_values(first, count, dst); }));
+    } else {
+      // We can only go through them once, so add them to the back and rotate
+      // them into place
+      const size_t old_size = size_;
+      try {
+        for (; first != last; ++first) {
+          emplace_back(*first);
+        }
+      } catch (...) {
+        std::destroy(begin_ + old_size, begin_ + size_);
+        size_ = static_cast<SizeT>(old_size);
+        throw;
+      }
+      std::rotate(begin_ + idx, begin_ + old_size, begin_ + size_);
+      return to_iterator(begin_ + idx);
     }
+  }
 
-    // If below is true, then, size_ must be > STATIC_AMOUNT
-    if (is_array())
-      spillover(size_);
+  // Inserts the values in `init` at `pos`
+  constexpr iterator insert(const_iterator pos, std::initializer_list<T> init) {
+    return insert(pos, init.begin(), init.end());
+  }
 
-    // If we spillover, we now have a vector, or we already had a vector
-    auto it = vec_->emplace(vec_->begin() + idx, std::forward<Args>(args)...);
-    // Bit of a nasty way of converting the vector's iterator to ours
-    return &(*it);
+  // Constructs a new value in-place at `pos` of the SmallVector
+  template <typename... Args>
+  constexpr iterator emplace(const_iterator pos, Args &&...args) {
+    const size_t idx = index_of(pos);
+    if (idx == size_)
+      return to_iterator(std::addressof(
+          emplace_back(std::forward<Args>(args)...)));
+    // `args` may refer to one of our own values, which open_gap() moves, so
+    // make the value before touching anything. That also means if its
+    // constructor throws there is no gap to close
+    T tmp(std::forward<Args>(args)...);
+    return to_iterator(fill_gap(idx, 1, [&tmp](T *dst) {
+      std::construct_at(dst, std::move(tmp));
+    }));
   }
 
   // Removes the value at the iterator `pos`, and returns the iterator for the
   // value after it
   constexpr iterator erase(const_iterator pos) {
-    const size_t idx = static_cast<size_t>(pos - cbegin());
-    if (is_vector()) {
-      // Vector case
-      auto it = vec_->erase(vec_->begin() + idx);
-      size_--;
-      return &(*it);
-    } else {
-      // Array case, let's destruct T at idx
-      T *val = get_arr_element_ptr(idx);
-      val->~T();
-      for (size_t i = idx + 1; i < size_; ++i) {
-        T *src = get_arr_element_ptr(i);
-        T *dst = get_arr_element_ptr(i - 1);
-        new (dst) T(std::move(*src));
-        src->~T();
-      }
-      size_--;
-      if (idx == size_) {
-        // If the deleted element was the last
-        return end();
-      } else {
-        // Else, just return the element in the spot
-        return get_arr_element_ptr(idx);
-      }
-    }
+    return erase(pos, pos + 1);
   }
 
   // Removes values from the `first` to `last` iterator (but not inclusive of
   // `last`). Returns the iterator to the first value after the last removed
   // value
   constexpr iterator erase(const_iterator first, const_iterator last) {
-    const size_t first_idx = static_cast<size_t>(first - cbegin());
-    const size_t last_idx = static_cast<size_t>(last - cbegin());
-    if (is_vector()) {
-      // Vector case
-      auto it =
-          vec_->erase(vec_->begin() + first_idx, vec_->begin() + last_idx);
-      size_ -= (last_idx - first_idx);
-      return &(*it);
-    } else {
-      // Array case, let's destruct T from first to last
-      const size_t diff = last_idx - first_idx;
-      for (size_t i = first_idx; i < last_idx; i++) {
-        T *val = get_arr_element_ptr(i);
-        val->~T();
-      }
-      for (size_t i = last_idx; i < size_; ++i) {
-        T *src = get_arr_element_ptr(i);
-        T *dst = get_arr_element_ptr(i - diff);
-        new (dst) T(std::move(*src));
-        src->~T();
-      }
-      size_ -= (last_idx - first_idx);
-      if (last_idx == size_) {
-        // If the deleted element was the last
-        return end();
-      } else {
-        // Else, just return the element in the spot
-        return get_arr_element_ptr(last_idx);
-      }
+    const size_t first_idx = index_of(first);
+    const size_t last_idx = index_of(last);
+    SMALLVECTOR_CHECK(first_idx <= last_idx, "Erasing a backwards range");
+    const size_t diff = last_idx - first_idx;
+    // Let's destruct T from first to last
+    std::destroy(begin_ + first_idx, begin_ + last_idx);
+    // Then shuffle the tail down into the gap
+    relocate_overlapping(begin_ + last_idx, size_ - last_idx,
+                         begin_ + first_idx);
+    size_ -= diff;
+    return to_iterator(begin_ + first_idx);
+  }
+
+  // Removes the value at `pos` by moving the last value into its place, so
+  // nothing else has to be shuffled down, but the order isn't kept. Returns
+  // `pos`, which now holds what was the last value (or is end())
+  constexpr iterator swap_erase(const_iterator pos) {
+    const size_t idx = index_of(pos);
+    SMALLVECTOR_CHECK(idx < size_, "Erasing end()");
+    T *hole = begin_ + idx;
+    T *last = begin_ + size_ - 1;
+    if (hole != last)
+      *hole = std::move(*last);
+    std::destroy_at(last);
+    --size_;
+    return to_iterator(hole);
+  }
+
+  // Removes every value `pred` returns true for, keeping the order of the
+  // rest. It's one pass, moving each kept value down at most once, and then
+  // the leftover tail is destructed all at once. Returns how many were removed
+  template <typename Pred> constexpr size_t remove_if(Pred pred) {
+    T *out = begin_;
+    T *const last = begin_ + size_;
+    while (out != last && !pred(*out)) {
+      ++out;
     }
+    if (out == last)
+      return 0;
+    for (T *it = out + 1; it != last; ++it) {
+      if (!pred(*it))
+        *out++ = std::move(*it);
+    }
+    const size_t removed = static_cast<size_t>(last - out);
+    std::destroy(out, last);
+    size_ -= static_cast<SizeT>(removed);
+    return removed;
+  }
+
+  // Removes every value equal to `value`, returning how many were removed
+  constexpr size_t remove(const T &value) {
+    return remove_if([&value](const T &x) { return x == value; });
   }
 
   // Pushes data to the back of our SmallVector
-  constexpr void push_back(T &&val) {
-    if (is_array()) {
-      if (size_ >= STATIC_AMOUNT) {
-        spillover(size_ + 1);
-        vec_->push_back(std::forward<T>(val));
-      } else {
-        new (get_arr_element_ptr(size_)) T(std::forward<T>(val));
-      }
+  constexpr void push_back(T &&val) { emplace_back(std::move(val)); }
+  // Pushes data to the back of our SmallVector
+  constexpr void push_back(const T &val) { emplace_back(val); }
+  // Pushes an initializer_list to the back of our SmallVector
+  constexpr void push_back_list(std::initializer_list<T> init) {
+    append_n(init.begin(), init.size());
+  }
+
+  // Adds the values in `range` to the back, growing at most once if we can
+  // count them up front
+  template <std::ranges::input_range R> constexpr void append_range(R &&range) {
+    if constexpr (std::ranges::forward_range<R>) {
+      append_n(std::ranges::begin(range),
+               static_cast<size_t>(std::ranges::distance(range)));
     } else {
-      vec_->push_back(std::forward<T>(val));
+      for (auto &&value : range) {
+        emplace_back(std::forward<decltype(value)>(value));
+      }
     }
-    size_++;
   }
-  // Pushes data to the back of our SmallVector
-  constexpr void push_back(const T &val) {
-    if (is_array()) {
-      if (size_ >= STATIC_AMOUNT) {
-        spillover(size_ + 1);
-        vec_->push_back(val);
-      } else {
-        new (get_arr_element_ptr(size_)) T(val);
-      }
+
+  // Replaces our values with the ones from `first` to `last` (which must not
+  // be our own)
+  template <std::input_iterator It> constexpr void assign(It first, It last) {
+    if constexpr (std::forward_iterator<It>) {
+      assign_from(first, static_cast<size_t>(std::distance(first, last)));
     } else {
-      vec_->push_back(val);
+      clear();
+      for (; first != last; ++first) {
+        emplace_back(*first);
+      }
     }
-    size_++;
   }
-  // Pushes an initializer_list to the back of our SmallVector
-  constexpr void push_back_list(std::initializer_list<T> init) {
-    reserve(init.size() + size());
-    std::copy(init.begin(), init.end(), std::back_inserter(*this));
+
+  // Replaces our values with `count` copies of `value`
+  constexpr void assign(size_t count, const T &value) {
+    const T copy(value); // `value` may be one of our own values
+    clear();
+    reserve(count);
+    fill_values(begin_, count, copy);
+    size_ = static_cast<SizeT>(count);
+    note_size();
+  }
+
+  // Replaces our values with the ones in `init`
+  constexpr void assign(std::initializer_list<T> init) {
+    assign_from(init.begin(), init.size());
   }
 
   // Constructs a new value in-place at the back of the SmallVector
-  template <typename... Args> constexpr void emplace_back(Args &&...args) {
-    if (is_array()) {
-      if (size_ >= STATIC_AMOUNT) {
-        spillover(size_ + 1);
-        vec_->emplace_back(std::forward<Args>(args)...);
-      } else {
-        T *dst = get_arr_element_ptr(size_);
-        new (dst) T(std::forward<Args>(args)...);
-      }
+  template <typename... Args> constexpr T &emplace_back(Args &&...args) {
+    if (size_ == capacity()) {
+      // `args` may refer to one of our own values, so build the new value
+      // before the spillover moves everything out from under it
+      T tmp(std::forward<Args>(args)...);
+      grow(size_ + 1);
+      std::construct_at(begin_ + size_, std::move(tmp));
     } else {
-      vec_->emplace_back(std::forward<Args>(args)...);
+      std::construct_at(begin_ + size_, std::forward<Args>(args)...);
     }
-    size_++;
+    ++size_;
+    note_size();
+    return begin_[size_ - 1];
   }
 
   // Removes the last element from the SmallVector, if empty this is UB
-  constexpr void pop_back() { erase(cend() - 1); }
+  constexpr void pop_back() {
+    SMALLVECTOR_CHECK(size_ != 0, "pop_back() on an empty SmallVector");
+    assert(size_ != 0);
+    std::destroy_at(begin_ + --size_);
+  }
 
   constexpr void resize(size_t count, const T &value) {
-    if (count == size_)
+    if (count <= size_) {
+      resize_with(count, [](T *, size_t) {});
       return;
-    if (count > max_size())
-      throw std::length_error("Requested resize above maximum size");
-
-    if (size_ > count) {
-      erase(begin() + count, end());
-    } else {
-      reserve(count);
-      for (size_t i = size_; i < count; ++i) {
-        push_back(value);
-      }
     }
+    const T copy(value); // `value` may be one of our own values
+    resize_with(count,
+                [&copy](T *dst, size_t n) { fill_values(dst, n, copy); });
   }
 
+  // New values are value-initialised, so zeroed for trivial types
   constexpr void resize(size_t count) {
-    if (count == size_)
-      return;
-    if (count > max_size())
-      throw std::length_error("Requested resize above maximum size");
+    resize_with(count,
+                [](T *dst, size_t n) { value_construct_values(dst, n); });
+  }
 
-    if (size_ > count) {
-      erase(begin() + count, end());
-    } else {
-      reserve(count);
-      for (size_t i = size_; i < count; ++i) {
-        emplace_back();
+  // Like resize(), but new values are default-initialised, so trivially
+  // default constructible values are left uninitialised. Handy for buffers
+  // that are about to be filled by read() / recv() etc
+  constexpr void resize_for_overwrite(size_t count) {
+    resize_with(count, [](T *dst, size_t n) {
+      // Uninitialised values can't be read in constant evaluation
+      if (std::is_constant_evaluated()) {
+        value_construct_values(dst, n);
+      } else {
+        std::uninitialized_default_construct_n(dst, n);
       }
-    }
+    });
   }
 
-  constexpr void swap(SmallVector &other) noexcept {
-    std::swap(arr_, other.arr_);
-    std::swap(vec_, other.vec_);
-    std::swap(size_, other.size_);
-  }
+  // ----- HELPFUL FUNCTIONS -----
+  // These aren't part of the vector / array interface, just nice to have
 
-  // ----- NON-MEMBER FUNCTIONS -----
-  constexpr bool operator==(const SmallVector<T> &other) const {
-    if (size_ != other.size())
-      return false;
-    return std::equal(begin(), end(), other.begin());
-  }
+  // Appends `other`, which may have a different static size, to the end of
+  // this SmallVector
+  template <typename... Rest>
+  constexpr void append(const SmallVectorImpl<T, Rest...> &other) {
+    const size_t other_size = other.size();
+    if (other_size == 0)
+      return;
 
-  constexpr bool operator!=(const SmallVector<T> &other) const {
-    return !(*this == other);
+    append_n(other.data(), other_size);
   }
 
-  // ----- HELPFUL FUNCTIONS -----
-  // These aren't part of the vector / array interface, just nice to have
-
-  // Appends `other` to the end of this SmallVector, clearing `other` after
-  constexpr void append(SmallVector<T> &&other) {
+  // Appends `other`, which may have a different static size, to the end of
+  // this SmallVector, clearing `other` after
+  template <typename... Rest>
+  constexpr void append(SmallVectorImpl<T, Rest...> &&other) {
     // Took until C++23 for std::vector to have something analgous to this
     // (std::append_rage), bit strange
-    if (this == &other)
+    if (static_cast<const void *>(this) == &other)
       return;
 
     const size_t other_size = other.size();
     if (other_size == 0)
       return;
 
-    reserve(size_ + other_size);
-
-    std::move(other.begin(), other.end(), std::back_inserter(*this));
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      // Moving is just copying, and this way big ones can be streamed
+      append_n(other.data(), other_size);
+    } else {
+      append_n(std::make_move_iterator(other.data()), other_size);
+    }
     other.clear();
   }
-  // Appends `other` to the end of this SmallVector
-  constexpr void append(const SmallVector<T> &other) {
-    const size_t other_size = other.size();
-    if (other_size == 0)
-      return;
 
-    reserve(size_ + other_size);
-    std::copy(other.begin(), other.end(), std::back_inserter(*this));
+  // Returns an iterator to the first value equal to `value`, or end() if there
+  // isn't one. Arithmetic types are compared a register at a time (simd.hpp)
+  constexpr iterator find(const T &value) {
+    return to_iterator(begin_ + find_index(value));
+  }
+  constexpr const_iterator find(const T &value) const {
+    return to_iterator(begin_ + find_index(value));
+  }
+
+  constexpr bool contains(const T &value) const {
+    return find_index(value) != size_;
   }
 
-  // Returns true if the internal storage is a vector
-  // False means it's an array
-  constexpr bool is_vector() const noexcept { return vec_.has_value(); }
+  // Returns how many values are equal to `value`
+  constexpr size_t count(const T &value) const {
+    if constexpr (simd::Searchable<T>) {
+      if (!std::is_constant_evaluated())
+        return simd::count(begin_, size_, value);
+    }
+    return static_cast<size_t>(std::count(begin_, begin_ + size_, value));
+  }
+
+  // Returns a view of our values, which is only valid until we next grow
+  constexpr std::span<T> as_span() noexcept { return {begin_, size_}; }
+  constexpr std::span<const T> as_span() const noexcept {
+    return {begin_, size_};
+  }
+
+  // Returns a view of the bytes of our values, e.g. to send or write them out
+  // without copying them somewhere else first (see serialize.hpp)
+  std::span<const std::byte> as_bytes() const noexcept
+    requires std::is_trivially_copyable_v<T>
+  {
+    return std::as_bytes(as_span());
+  }
+  std::span<std::byte> as_writable_bytes() noexcept
+    requires std::is_trivially_copyable_v<T>
+  {
+    return std::as_writable_bytes(as_span());
+  }
+
+  // Returns true if the values live in a heap block
+  // False means they're in the static storage (array)
+  constexpr bool is_vector() const noexcept {
+    if (std::is_constant_evaluated())
+      return (capacity_ & HEAP_FLAG) != 0;
+    return begin_ != inline_storage();
+  }
 
   // Returns true if the internal storage is an array
   // False means it's a vector
   constexpr bool is_array() const noexcept { return !is_vector(); }
 
-  // Returns an optional value, containing the internal vector
-  // If is_vector() == true, this returns an optional containing the vector
-  // If it isn't true, then the optional is empty (!has_value)
-  constexpr std::optional<VecT> &get_vec() { return vec_; }
+  // Returns the allocator used for the heap block
+  constexpr allocator_type get_allocator() const noexcept { return alloc_; }
+};
+
+// Compares the values, so SmallVectors with different static sizes (or size
+// types, allocators...) are equal when they hold the same values
+template <typename T, typename... A, typename... B>
+constexpr bool operator==(const SmallVectorImpl<T, A...> &lhs,
+                          const SmallVectorImpl<T, B...> &rhs) {
+  if (lhs.size() != rhs.size())
+    return false;
+  if constexpr (simd::Searchable<T>) {
+    if (!std::is_constant_evaluated())
+      return simd::equal(lhs.data(), rhs.data(), lhs.size());
+  }
+  return std::equal(lhs.data(), lhs.data() + lhs.size(), rhs.data());
+}
+
+// Keeps up to STATIC_AMOUNT values inline before spilling over onto the heap.
+// All the vector operations come from SmallVectorImpl, which a
+// SmallVector<T, N> can be passed as to not care about N
+template <typename T, size_t STATIC_AMOUNT = calculate_static_size(sizeof(T)),
+          typename SizeT = size_t, typename Allocator = std::allocator<T>,
+          typename GrowthPolicy = GrowBy2,
+          typename Instrumentation = NoInstrumentation>
+class SmallVector
+    : public SmallVectorImpl<T, SizeT, Allocator, GrowthPolicy,
+                             Instrumentation> {
+private:
+  using Impl =
+      SmallVectorImpl<T, SizeT, Allocator, GrowthPolicy, Instrumentation>;
+  using typename Impl::AllocTraits;
+  using Impl::alloc_;
+  using Impl::begin_;
+  using Impl::NOTHROW_RELOCATE;
+  using Impl::size_;
+  static_assert(STATIC_AMOUNT <= std::numeric_limits<SizeT>::max(),
+                "STATIC_AMOUNT doesn't fit in SizeT");
+
+  // Once this overflows, begin_ points at a heap block instead
+  SmallVectorStorage<T, STATIC_AMOUNT> arr_;
+
+  // Where arr_ really is, which SmallVectorImpl had better agree with
+  static consteval size_t arr_offset() {
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+#endif
+    return offsetof(SmallVector, arr_);
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+  }
+
+  // Just two nice helper functions
+  constexpr T *get_arr_ptr() noexcept { return arr_.values; }
+  constexpr const T *get_arr_ptr() const noexcept { return arr_.values; }
+
+  // Points us back at the (empty) static storage
+  constexpr void reset_to_array() noexcept {
+    this->set_storage(get_arr_ptr(), STATIC_AMOUNT, false);
+  }
+
+  // Takes the values from `other`, which is left empty. We must be empty and
+  // in array mode beforehand
+  constexpr void take_from(SmallVector &&other) {
+    this->instrumentation_ =
+        std::exchange(other.instrumentation_, Instrumentation());
+    if (other.is_vector() && alloc_ == other.alloc_) {
+      // Just steal the heap block
+      this->set_storage(other.begin_, other.capacity(), true);
+      size_ = other.size_;
+      other.reset_to_array();
+      other.size_ = 0;
+    } else {
+      // Either other is in array mode, or its heap block came from an
+      // allocator we can't free it with, so move just the live values over
+      this->reserve(other.size_);
+      Impl::relocate(other.begin_, other.size_, begin_);
+      size_ = other.size_;
+      other.size_ = 0;
+    }
+  }
+
+  // Swaps the values of two array mode SmallVectors, only touching the live
+  // values
+  static constexpr void swap_arrays(SmallVector &a, SmallVector &b) {
+    SmallVector &smaller = a.size_ < b.size_ ? a : b;
+    SmallVector &larger = a.size_ < b.size_ ? b : a;
+    const size_t common = smaller.size_;
+    std::swap_ranges(smaller.begin_, smaller.begin_ + common, larger.begin_);
+    Impl::relocate(larger.begin_ + common, larger.size_ - common,
+                   smaller.begin_ + common);
+    std::swap(smaller.size_, larger.size_);
+  }
+
+  // Gives `heap`'s block to `array`, and moves `array`'s values into `heap`'s
+  // static storage
+  static constexpr void swap_heap_with_array(SmallVector &heap,
+                                             SmallVector &array) {
+    T *block = heap.begin_;
+    const size_t block_capacity = heap.capacity();
+    const size_t block_size = heap.size_;
+    heap.reset_to_array();
+    Impl::relocate(array.begin_, array.size_, heap.begin_);
+    heap.size_ = array.size_;
+    array.set_storage(block, block_capacity, true);
+    array.size_ = block_size;
+  }
+
+public:
+  constexpr SmallVector() : SmallVector(Allocator()) {};
+
+  constexpr explicit SmallVector(const Allocator &alloc) : Impl(alloc) {
+    static_assert(arr_offset() == Impl::inline_offset(),
+                  "SmallVectorImpl can't find the static storage");
+    reset_to_array();
+    // A constexpr variable has to be fully initialised to be written out, and
+    // that includes the unused part of arr_. For trivial types, that's cheap
+    if constexpr (std::is_trivial_v<T>) {
+      if (std::is_constant_evaluated()) {
+        for (size_t i = 0; i < STATIC_AMOUNT; ++i) {
+          std::construct_at(arr_.values + i);
+        }
+      }
+    }
+  }
+
+  constexpr explicit SmallVector(size_t count,
+                                 const Allocator &alloc = Allocator())
+      : SmallVector(alloc) {
+    this->resize(count);
+  }
+
+  constexpr SmallVector(size_t count, const T &value,
+                        const Allocator &alloc = Allocator())
+      : SmallVector(alloc) {
+    this->resize(count, value);
+  }
+
+  // Like SmallVector(count), but trivially default constructible values are
+  // left uninitialised, for when they're about to be overwritten anyway
+  constexpr SmallVector(size_t count, default_init_t,
+                        const Allocator &alloc = Allocator())
+      : SmallVector(alloc) {
+    this->resize_for_overwrite(count);
+  }
+
+  constexpr SmallVector(std::initializer_list<T> init,
+                        const Allocator &alloc = Allocator())
+      : SmallVector(alloc) {
+    this->reserve(init.size());
+    this->append_n(init.begin(), init.size());
+  }
+
+  constexpr ~SmallVector() {
+    this->clear();
+    this->free_heap();
+  };
+
+  constexpr SmallVector(const SmallVector &other)
+      : SmallVector(
+            AllocTraits::select_on_container_copy_construction(other.alloc_)) {
+    this->reserve(other.size_);
+    Impl::copy_values(other.begin_, other.size_, begin_);
+    size_ = other.size_;
+    this->note_size();
+  }
+
+  // Only relocates the values if other is in array mode, so as long as that
+  // can't throw neither can this, and std::vector etc will move us
+  constexpr SmallVector(SmallVector &&other) noexcept(NOTHROW_RELOCATE)
+      : SmallVector(std::move(other.alloc_)) {
+    take_from(std::move(other));
+  }
+
+  constexpr SmallVector &operator=(const SmallVector &other) {
+    if (this == &other)
+      return *this;
+    if constexpr (AllocTraits::propagate_on_container_copy_assignment::value) {
+      if (alloc_ != other.alloc_)
+        release(); // Our heap block has to go back to our old allocator
+      alloc_ = other.alloc_;
+    }
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      // No destructors to run, so just copy the live bytes straight over
+      if (other.size_ > this->capacity()) {
+        size_ = 0;
+        this->reserve(other.size_);
+      }
+      Impl::copy_values(other.begin_, other.size_, begin_);
+      size_ = other.size_;
+      this->note_size();
+    } else {
+      this->assign_from(other.begin_, other.size_);
+    }
+    return *this;
+  }
+
+  // With unequal allocators that don't propagate, the values have to be moved
+  // into our own heap block, which can throw
+  constexpr SmallVector &operator=(SmallVector &&other) noexcept(
+      NOTHROW_RELOCATE && std::is_nothrow_move_assignable_v<T> &&
+      (AllocTraits::propagate_on_container_move_assignment::value ||
+       AllocTraits::is_always_equal::value)) {
+    if (this == &other)
+      return *this;
+    if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+      if (alloc_ != other.alloc_) {
+        release(); // Our heap block has to go back to our old allocator
+        alloc_ = other.alloc_;
+      }
+    }
+    if (other.is_vector() && alloc_ == other.alloc_) {
+      // Steal other's heap block in O(1)
+      release();
+      take_from(std::move(other));
+    } else {
+      this->assign_from(std::make_move_iterator(other.begin_), other.size_);
+      other.clear();
+    }
+    return *this;
+  }
 
-  // Returns an optional value, containing the internal vector
-  // If is_vector() == true, this returns an optional containing the vector
-  // If it isn't true, then the optional is empty (!has_value)
-  constexpr const std::optional<VecT> &get_vec() const { return vec_; }
+  // Swapping with unequal allocators that don't propagate goes through a
+  // temporary, which can throw
+  constexpr void swap(SmallVector &other) noexcept(
+      std::is_nothrow_move_constructible_v<T> &&
+      std::is_nothrow_swappable_v<T> &&
+      (AllocTraits::propagate_on_container_swap::value ||
+       AllocTraits::is_always_equal::value)) {
+    if (this == &other)
+      return;
+    if (!AllocTraits::propagate_on_container_swap::value &&
+        alloc_ != other.alloc_) {
+      // Neither heap block can change hands, so go the long way around
+      SmallVector tmp(std::move(other));
+      other = std::move(*this);
+      *this = std::move(tmp);
+      return;
+    }
+    if constexpr (AllocTraits::propagate_on_container_swap::value) {
+      using std::swap;
+      swap(alloc_, other.alloc_);
+    }
+    std::swap(this->instrumentation_, other.instrumentation_);
+    if (this->is_vector() && other.is_vector()) {
+      // Both on the heap, so we can just trade blocks
+      T *block = begin_;
+      const size_t block_capacity = this->capacity();
+      this->set_storage(other.begin_, other.capacity(), true);
+      other.set_storage(block, block_capacity, true);
+      std::swap(size_, other.size_);
+    } else if (this->is_vector()) {
+      swap_heap_with_array(*this, other);
+    } else if (other.is_vector()) {
+      swap_heap_with_array(other, *this);
+    } else {
+      swap_arrays(*this, other);
+    }
+  }
+
+  // Clears the SmallVector and frees the heap block (if any), going back to
+  // the array
+  constexpr void release() {
+    this->clear();
+    this->free_heap();
+    reset_to_array();
+  }
+
+  // If we are in vector mode but the values would fit in the static storage,
+  // moves them back into the array and frees the heap block. Returns true if
+  // we are in array mode afterwards
+  constexpr bool shrink_to_inline() {
+    if (this->is_array())
+      return true;
+    if (size_ > STATIC_AMOUNT)
+      return false;
+    T *block = begin_;
+    const size_t block_capacity = this->capacity();
+    if constexpr (!NOTHROW_RELOCATE) {
+      // Same as move_to_block(), if one throws we still have all our values
+      Impl::copy_values(Impl::transfer_from(block), size_, get_arr_ptr());
+      std::destroy_n(block, size_);
+    } else {
+      Impl::relocate(block, size_, get_arr_ptr());
+    }
+    reset_to_array();
+    AllocTraits::deallocate(alloc_, block, block_capacity);
+    return true;
+  }
+
+  // Has no side effects if using the internal static storage. Otherwise, if
+  // the values fit in the static storage again they move back there and the
+  // heap block is freed, else the heap block shrinks down to the current size
+  constexpr void shrink_to_fit() {
+    if (shrink_to_inline() || size_ == this->capacity())
+      return;
+    this->spillover(size_, size_);
+  }
+
+  using Impl::append;
+
+  // Appends `other` to the end of this SmallVector, clearing `other` after.
+  // If we're empty and `other` is on the heap, we just take its heap block
+  constexpr void append(SmallVector &&other) {
+    if (this != &other && size_ == 0 && other.is_vector() &&
+        alloc_ == other.alloc_) {
+      release();
+      take_from(std::move(other));
+      return;
+    }
+    Impl::append(static_cast<Impl &&>(other));
+  }
 
   // Returns the STATIC_SIZE calculated by calculate_static_size()
   constexpr size_t get_static_size() const { return STATIC_AMOUNT; }
 };
+
+// Like C++20's std::erase() / std::erase_if() for std::vector
+template <typename T, typename... Rest, typename U>
+constexpr size_t erase(SmallVectorImpl<T, Rest...> &v, const U &value) {
+  return v.remove_if([&value](const T &x) { return x == value; });
+}
+
+template <typename T, typename... Rest, typename Pred>
+constexpr size_t erase_if(SmallVectorImpl<T, Rest...> &v, Pred pred) {
+  return v.remove_if(pred);
+}
+
+namespace pmr {
+// A SmallVector which spills over into a std::pmr::memory_resource. Note the
+// values themselves aren't given the allocator (no uses-allocator
+// construction), only the heap block comes from the resource
+template <typename T,
+          size_t STATIC_AMOUNT = calculate_static_size(
+              sizeof(T), header_size_bytes() +
+                             sizeof(std::pmr::polymorphic_allocator<T>))>
+using SmallVector =
+    ::SmallVector<T, STATIC_AMOUNT, size_t, std::pmr::polymorphic_allocator<T>>;
+} // namespace pmr